@@ -5,20 +5,28 @@ set -e
 RETRO68_PATH=~/Documents/Code/Retro68-build/
 
 ################################################################################
-echo "Building Fix-a-Fork-Carbon (PowerPC-only)..."
+echo "Building Fix-a-Fork-Carbon (68K and PowerPC)..."
 
 echo "Cleaning out previous builds..."
-rm -rf build-ppc
-mkdir build-ppc
+rm -rf build-68k build-ppc
+mkdir build-68k build-ppc
 
 echo "Compiling..."
+cmake -S . -B build-68k -DCMAKE_TOOLCHAIN_FILE=$RETRO68_PATH/toolchain/m68k-apple-macos/cmake/retro68.toolchain.cmake
+cmake --build build-68k
 cmake -S . -B build-ppc -DCMAKE_TOOLCHAIN_FILE=$RETRO68_PATH/toolchain/powerpc-apple-macos/cmake/retroppc.toolchain.cmake
 cmake --build build-ppc
 
 echo "Rez everything up..."
 
-$RETRO68_PATH/toolchain/bin/Rez -DCFRAG_NAME="\"fix-a-fork-carbon\"" -t APPL -c FAF  --data build-ppc/fix-a-fork-carbon.pef build-ppc/fix-a-fork-carbon.r.rsrc.bin
+# Fat app: the PowerPC fragment in the data fork, the 68K CODE resources
+# in the resource fork. The Process Manager picks whichever fits.
+# Creators match CMakeLists.txt.
+for app in "fix-a-fork-carbon:FAF " "fix-a-fork-server:FAFs"; do
+	creator="${app#*:}"
+	app="${app%%:*}"
+	$RETRO68_PATH/toolchain/bin/Rez -DCFRAG_NAME="\"$app\"" -t APPL -c "$creator" --data build-ppc/$app.pef build-ppc/$app.r.rsrc.bin \
+		--copy build-68k/$app.code.bin -o build-ppc/$app-fat.bin
+done
 
 echo "Finished building!"
-
-
@@ -0,0 +1,168 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+
+#include "catsearch.h"
+#include <Memory.h>
+#include <string.h>
+
+#define kSearchMatches 64
+#define kSearchSlice 50			// ms per PBCatSearch call
+#define kSearchBuffer 16384		// catalog read buffer, optional
+#define kSearchRestarts 3
+
+// The passes. A file with a generic type is found by its type pass, so
+// the creator passes skip those.
+static const struct {
+	Boolean creator;
+	OSType value;
+} kSearchPasses[] = {
+	{ false, 0 },
+	{ false, '????' },
+	{ false, 'BINA' },
+	{ true, 0 },
+	{ true, '????' },
+};
+
+#define kNumPasses ((short)(sizeof(kSearchPasses) / sizeof(kSearchPasses[0])))
+
+static Boolean GenericType(OSType type)
+{
+	return type == 0 || type == '????' || type == 'BINA';
+}
+
+Boolean CatSearchAvailable(short vRefNum)
+{
+	GetVolParmsInfoBuffer parms;
+	HParamBlockRec pb;
+
+	memset(&pb, 0, sizeof(pb));
+	pb.ioParam.ioVRefNum = vRefNum;
+	pb.ioParam.ioBuffer = (Ptr)&parms;
+	pb.ioParam.ioReqCount = sizeof(parms);
+	if(PBHGetVolParmsSync(&pb) != noErr)
+		return false;
+	return (parms.vMAttrib & (1L << bHasCatSearch)) != 0;
+}
+
+// parID, then the name as a Pascal string, padded to an even length.
+static OSErr Append(Handle found, const FSSpec *fss)
+{
+	Byte rec[sizeof(long) + sizeof(Str63)];
+	long len = sizeof(long) + fss->name[0] + 1;
+
+	BlockMoveData(&fss->parID, rec, sizeof(long));
+	BlockMoveData(fss->name, rec + sizeof(long), fss->name[0] + 1);
+	if(len & 1)
+		rec[len++] = 0;
+	return PtrAndHand(rec, found, len);
+}
+
+// True if fss was already found by a type pass.
+static Boolean FoundByType(const FSSpec *fss)
+{
+	CInfoPBRec pb;
+	Str63 name;
+
+	BlockMoveData(fss->name, name, fss->name[0] + 1);
+	pb.hFileInfo.ioNamePtr = name;
+	pb.hFileInfo.ioVRefNum = fss->vRefNum;
+	pb.hFileInfo.ioDirID = fss->parID;
+	pb.hFileInfo.ioFDirIndex = 0;
+	return PBGetCatInfoSync(&pb) == noErr && GenericType(pb.hFileInfo.ioFlFndrInfo.fdType);
+}
+
+static OSErr SearchPass(short vRefNum, short pass, Ptr buffer, Handle found, long *count, CatSearchIdleProc idle, void *refCon)
+{
+	FSSpec matches[kSearchMatches];
+	CInfoPBRec spec1, spec2;
+	CSParam pb;
+	OSErr err;
+	long i;
+
+	memset(&spec1, 0, sizeof(spec1));
+	memset(&spec2, 0, sizeof(spec2));
+	// Files only: the folder bit is masked in and must be clear.
+	spec2.hFileInfo.ioFlAttrib = ioDirMask;
+	if(kSearchPasses[pass].creator)
+	{
+		spec1.hFileInfo.ioFlFndrInfo.fdCreator = kSearchPasses[pass].value;
+		spec2.hFileInfo.ioFlFndrInfo.fdCreator = 0xFFFFFFFF;
+	}
+	else
+	{
+		spec1.hFileInfo.ioFlFndrInfo.fdType = kSearchPasses[pass].value;
+		spec2.hFileInfo.ioFlFndrInfo.fdType = 0xFFFFFFFF;
+	}
+
+	memset(&pb, 0, sizeof(pb));
+	pb.ioVRefNum = vRefNum;
+	pb.ioMatchPtr = matches;
+	pb.ioReqMatchCount = kSearchMatches;
+	pb.ioSearchBits = fsSBFlAttrib | fsSBFlFndrInfo;
+	pb.ioSearchInfo1 = &spec1;
+	pb.ioSearchInfo2 = &spec2;
+	pb.ioSearchTime = kSearchSlice;
+	pb.ioOptBuffer = buffer;
+	pb.ioOptBufSize = buffer ? kSearchBuffer : 0;
+	// initialize == 0 starts at the beginning of the catalog; after each
+	// call ioCatPosition says where to carry on.
+	pb.ioCatPosition.initialize = 0;
+
+	do {
+		err = PBCatSearchSync(&pb);
+		if(err && err != eofErr)
+			return err;
+		for(i = 0; i < pb.ioActMatchCount; i++)
+		{
+			if(kSearchPasses[pass].creator && FoundByType(&matches[i]))
+				continue;
+			if(Append(found, &matches[i]) != noErr)
+				return memFullErr;
+			++*count;
+		}
+		if(!idle(refCon))
+			return userCanceledErr;
+	} while(err != eofErr);
+	return noErr;
+}
+
+OSErr CatSearchGeneric(short vRefNum, Handle found, long *count, CatSearchIdleProc idle, void *refCon)
+{
+	long start = GetHandleSize(found), before = *count;
+	short pass, restarts = 0;
+	Ptr buffer = NewPtr(kSearchBuffer);
+	OSErr err = noErr;
+
+	for(pass = 0; pass < kNumPasses; pass++)
+	{
+		err = SearchPass(vRefNum, pass, buffer, found, count, idle, refCon);
+		if(err == catChangedErr && restarts++ < kSearchRestarts)
+		{
+			// Everything found so far may be out of date.
+			SetHandleSize(found, start);
+			*count = before;
+			pass = -1;
+			continue;
+		}
+		if(err)
+			break;
+	}
+	if(buffer)
+		DisposePtr(buffer);
+	return err;
+}
+
+Boolean CatSearchNext(Handle found, long *offset, short vRefNum, FSSpec *fss)
+{
+	long len;
+
+	if(*offset >= GetHandleSize(found))
+		return false;
+	fss->vRefNum = vRefNum;
+	BlockMoveData(*found + *offset, &fss->parID, sizeof(long));
+	len = (*found)[*offset + sizeof(long)] + 1;
+	BlockMoveData(*found + *offset + sizeof(long), fss->name, len);
+	*offset += sizeof(long) + len + (len & 1);
+	return true;
+}
@@ -0,0 +1,27 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+#ifndef __CATSEARCH_H__
+#define __CATSEARCH_H__
+
+// Whole volumes by catalog search: PBCatSearch makes one sequential
+// pass over the catalog B-tree and hands back only the files with a
+// blank, ???? or BINA type or creator, the ones a generic-only batch
+// would look at. A walk would visit every file and folder instead.
+
+#include <MacTypes.h>
+#include <Files.h>
+
+// Runs between slices of the search; false stops it with
+// userCanceledErr.
+typedef Boolean (*CatSearchIdleProc)(void *refCon);
+
+Boolean CatSearchAvailable(short vRefNum);
+// Appends every match on vRefNum to found, packed for CatSearchNext,
+// and adds their number to *count. Nothing may write to the catalog
+// meanwhile; if something does, the search starts over.
+OSErr CatSearchGeneric(short vRefNum, Handle found, long *count, CatSearchIdleProc idle, void *refCon);
+// The match at *offset, which starts at 0. False past the last one.
+Boolean CatSearchNext(Handle found, long *offset, short vRefNum, FSSpec *fss);
+
+#endif
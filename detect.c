@@ -0,0 +1,236 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+
+#include "detect.h"
+#include "file_ext.h"
+#include <stdbool.h>
+#include <string.h>
+
+// Order matters, loose checks go last. minCount keeps checks that look
+// past the first block from firing on short files.
+static const struct {
+	char *name;
+	DetectProc proc;
+	long minCount;
+} detectors[] = {
+	{ "BinHex4", isBinHex4, 0 },
+	{ "Sit5", isSit5, 0 },
+	{ "Sit15", isSit15, 0 },
+	{ "BinSit", isBinSit, 0 },
+	{ "Dsk4", isDsk4, 0 },
+	{ "Zip", isZip, 0 },
+	{ "Mar", isMar, 0 },
+	{ "Cpt", isCpt, 0 },
+	// Checks @ 1024
+	{ "Dsk_1024", isDsk_1024, SNIFF_SIZE },
+};
+
+#define kNumDetectors ((short)(sizeof(detectors) / sizeof(detectors[0])))
+
+static Boolean MatchScalar(const Byte *p, const char *magic, short len)
+{
+	short i;
+	for(i = 0; i < len; i++)
+		if(p[i] != (Byte)magic[i])
+			return false;
+	return true;
+}
+
+static void ClearScalar(Byte *p, long len)
+{
+	memset(p, 0, len);
+}
+
+static MatchProc gMatch = MatchScalar;
+static ClearProc gClear = ClearScalar;
+
+// Set once, before any sniffing. nil puts back the scalar one.
+void DetectSetKernels(MatchProc match, ClearProc clear)
+{
+	gMatch = match ? match : MatchScalar;
+	gClear = clear ? clear : ClearScalar;
+}
+
+void SniffPad(SniffRec *s)
+{
+	if(s->count < 0)
+		s->count = 0;
+	if(s->count < SNIFF_SIZE)
+		gClear(s->buf + s->count, SNIFF_SIZE - s->count);
+	s->type = 0;
+	s->creator = 0;
+	s->detector = kDetectNone;
+}
+
+Boolean SniffHeader(SniffRec *s)
+{
+	short i;
+
+	for(i = 0; i < kNumDetectors; i++)
+	{
+		if(s->count < detectors[i].minCount)
+			continue;
+		if(detectors[i].proc(s))
+		{
+			s->detector = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+Boolean SniffName(SniffRec *s, const unsigned char *fName)
+{
+	char ext[6] = {0};
+
+	if(!ParseFileExt(fName, ext))
+		return false;
+	if(!CheckFileExt(ext, &s->type, &s->creator))
+		return false;
+	s->detector = kDetectExt;
+	return true;
+}
+
+Boolean SniffFile(SniffRec *s, const unsigned char *fName)
+{
+	if(SniffHeader(s))
+		return true;
+	return SniffName(s, fName);
+}
+
+short DetectorCount()
+{
+	return kNumDetectors;
+}
+
+const char *DetectorName(short detector)
+{
+	if(detector >= 0 && detector < kNumDetectors)
+		return detectors[detector].name;
+	if(detector == kDetectExt)
+		return "Ext";
+	return "None";
+}
+
+// Copies the lowercased extension of the Pascal string fName into ext,
+// which must hold at least 6 bytes. Names of 5 characters or less without
+// a '.' are treated as all extension, as they always have been.
+Boolean ParseFileExt(const unsigned char *fName, char *ext)
+{
+	short i = 0, j = 0;
+
+	for(i = fName[0]; i > 0; i--)
+		if(fName[i] == '.')
+			break;
+	if(i == fName[0] || (fName[0] - i) > 5) // There is no extension
+		return false;
+
+	i = i + 1; // increment to avoid '.'
+	for(; i <= fName[0]; i++)
+	{
+		char c = fName[i];
+		// Same result as LowerText for everything in the ext table.
+		if(c >= 'A' && c <= 'Z')
+			c += 'a' - 'A';
+		ext[j++] = c;
+	}
+	ext[j] = 0;
+	return true;
+}
+
+Boolean isBinHex4(SniffRec *s)
+{
+	// FixMe: Magic can be any line in the first 8k of the file.
+	return magicCheck(s, "BinHex 4.0", 10, 34, 'BINA', 'SITx');
+}
+
+Boolean isSit15(SniffRec *s)
+{
+	short stuffitVersion = 0;
+	if(magicCheck(s, "SIT!", 4, 0, 'SIT!', 'SIT!'))
+	{
+		s->type = 0;
+		s->creator = 0;
+		// 0x01 for 1.5.x, 0x02 for 1.6-4.5
+		stuffitVersion = s->buf[14];
+		return (stuffitVersion == 0x01 || stuffitVersion == 0x02) && magicCheck(s, "rLau", 4, 10, 'SIT!', 'SIT!');
+	}
+	return false;
+}
+
+Boolean isSit5(SniffRec *s)
+{
+	short stuffitVersion = s->buf[82]; // 0x05
+	return (stuffitVersion == 0x05 && magicCheck(s, "StuffIt (c)1997", 15, 0, 'SITD', 'SIT!'));
+}
+
+Boolean isBinSit(SniffRec *s)
+{
+	short stuffitVersion = 0;
+	if(magicCheck(s, "SIT!", 4, 0 + 128, 'SIT!', 'SIT!'))
+	{
+		s->type = 0;
+		s->creator = 0;
+		// 0x01 for 1.5.x, 0x02 for 1.6-4.5
+		stuffitVersion = s->buf[14 + 128];
+		return (stuffitVersion == 0x01 || stuffitVersion == 0x02) && magicCheck(s, "rLau", 4, 10 + 128, 'BINA', 'SITx');
+	}
+	return false;
+}
+
+Boolean isDsk4(SniffRec *s)
+{
+	char magic[] = "\1\0";
+	return  magicCheck(s, magic, 2, 52, 'dImg', 'dCpy');
+}
+// Disk Copy 6
+Boolean isDsk_1024(SniffRec *s)
+{
+	return  magicCheck(s, "BD", 2, BUF_SIZE, 'DDim', 'ddsk');
+}
+
+// Very loose check, do last.
+Boolean isCpt(SniffRec *s)
+{
+	char magic[] = "\1\1";
+	return  magicCheck(s, magic, 2, 0, 'PACT', 'CPCT');
+}
+
+Boolean isMar(SniffRec *s)
+{
+	return  magicCheck(s, "MAR", 3, 0, 'MARf', 'MARc');
+}
+
+Boolean isZip(SniffRec *s)
+{
+	return  magicCheck(s, "PK", 2, 0, 'ZIP ', 'IZip');
+}
+
+short StringLen(const char *str)
+{
+	const char *s;
+	for (s  = str; *s; ++s);
+	return (s-str);
+}
+
+Boolean StringCompare(const char *lhs, const char *rhs)
+{
+	short i = 0;
+	short len = StringLen(lhs);
+	if(len != StringLen(rhs)) return false;
+
+	for(i = 0; i < len; i++)
+		if(lhs[i] != rhs[i])
+			return false;
+	return true;
+}
+
+Boolean magicCheck(SniffRec *s, char *magic, short len, short offset, OSType type, OSType creator)
+{
+	if(!gMatch(s->buf + offset, magic, len))
+		return false;
+	s->type = type;
+	s->creator = creator;
+	return true;
+}
@@ -0,0 +1,61 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+#ifndef __DETECT_H__
+#define __DETECT_H__
+
+// Detection core shared by the Mac app and the host tools. Nothing in
+// here may call the Toolbox; it only looks at bytes and names.
+
+#include <MacTypes.h>
+
+#define BUF_SIZE 1024
+// First two blocks of the data fork, enough for every detector.
+#define SNIFF_SIZE (BUF_SIZE * 2)
+
+// Values of SniffRec.detector that are not header detectors.
+#define kDetectNone -1
+#define kDetectExt -2
+
+typedef struct {
+	Byte buf[SNIFF_SIZE];	// start of the data fork, zero padded
+	long count;				// bytes actually read into buf
+	OSType type;
+	OSType creator;
+	short detector;			// index of the detector that fired
+} SniffRec;
+
+typedef Boolean (*DetectProc)(SniffRec *s);
+
+// The byte kernels every detector runs on. They start out scalar; the
+// app swaps in vector ones on a G4 (see detect_vec.h).
+typedef Boolean (*MatchProc)(const Byte *p, const char *magic, short len);
+typedef void (*ClearProc)(Byte *p, long len);
+void DetectSetKernels(MatchProc match, ClearProc clear);
+
+// Zero pads past s->count so short files never see stale bytes, and
+// clears the previous verdict.
+void SniffPad(SniffRec *s);
+// Runs the header detectors, then the extension table on fName.
+Boolean SniffFile(SniffRec *s, const unsigned char *fName);
+Boolean SniffHeader(SniffRec *s);
+Boolean SniffName(SniffRec *s, const unsigned char *fName);
+const char *DetectorName(short detector);
+// Header detectors, numbered 0 to DetectorCount() - 1.
+short DetectorCount();
+
+// checks
+short StringLen(const char *str);
+Boolean StringCompare(const char *lhs, const char *rhs);
+Boolean ParseFileExt(const unsigned char *fName, char *ext);
+Boolean magicCheck(SniffRec *s, char *magic, short len, short offset, OSType type, OSType creator);
+Boolean isBinHex4(SniffRec *s);
+Boolean isSit5(SniffRec *s);
+Boolean isSit15(SniffRec *s);
+Boolean isBinSit(SniffRec *s);
+Boolean isDsk4(SniffRec *s);
+Boolean isZip(SniffRec *s);
+Boolean isMar(SniffRec *s);
+Boolean isCpt(SniffRec *s);
+Boolean isDsk_1024(SniffRec *s);
+#endif
@@ -0,0 +1,45 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+
+#include "detect_68k.h"
+#include <stdbool.h>
+
+Boolean MatchLongs(const Byte *p, const char *magic, short len)
+{
+	const Byte *m = (const Byte *)magic;
+
+	// Both even: whole longs (big-endian, so plain compares), then a
+	// word. Otherwise fall through to bytes.
+	if(!(((long)p | (long)m) & 1))
+	{
+		for(; len >= 4; len -= 4, p += 4, m += 4)
+			if(*(const UInt32 *)p != *(const UInt32 *)m)
+				return false;
+		if(len >= 2)
+		{
+			if(*(const UInt16 *)p != *(const UInt16 *)m)
+				return false;
+			len -= 2;
+			p += 2;
+			m += 2;
+		}
+	}
+	for(; len > 0; len--)
+		if(*p++ != *m++)
+			return false;
+	return true;
+}
+
+void ClearLongs(Byte *p, long len)
+{
+	if(len > 0 && ((long)p & 1))
+	{
+		*p++ = 0;
+		len--;
+	}
+	for(; len >= 4; len -= 4, p += 4)
+		*(UInt32 *)p = 0;
+	for(; len > 0; len--)
+		*p++ = 0;
+}
@@ -0,0 +1,16 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+#ifndef __DETECT_68K_H__
+#define __DETECT_68K_H__
+
+// 68K versions of the detection kernels: long-word compares and fills,
+// never touching a long or word at an odd address, which faults on a
+// 68000 and costs an extra bus cycle on later chips.
+
+#include "detect.h"
+
+Boolean MatchLongs(const Byte *p, const char *magic, short len);
+void ClearLongs(Byte *p, long len);
+
+#endif
@@ -0,0 +1,52 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+
+#include "detect_vec.h"
+#include <altivec.h>
+
+typedef vector unsigned char VByte;
+
+// Up to 16 bytes from p, which needn't be aligned. The second load is
+// of the last byte wanted, so nothing past p + len is touched.
+static VByte LoadBytes(const Byte *p, short len)
+{
+	VByte lo = vec_ld(0, p);
+	VByte hi = vec_ld(len - 1, p);
+	return vec_perm(lo, hi, vec_lvsl(0, p));
+}
+
+// 16 bytes at a time; the last block is masked to what's left.
+Boolean MatchVector(const Byte *p, const char *magic, short len)
+{
+	const Byte *m = (const Byte *)magic;
+	union { Byte b[16]; VByte v; } n;
+	VByte diff, mask;
+	short take;
+
+	while(len > 0)
+	{
+		take = len < 16 ? len : 16;
+		n.b[0] = take;
+		mask = (VByte)vec_cmpgt(vec_splat(n.v, 0), vec_lvsl(0, (Byte *)0));
+		diff = vec_and(vec_xor(LoadBytes(p, take), LoadBytes(m, take)), mask);
+		if(!vec_all_eq(diff, vec_splat_u8(0)))
+			return false;
+		p += take;
+		m += take;
+		len -= take;
+	}
+	return true;
+}
+
+void ClearVector(Byte *p, long len)
+{
+	VByte zero = vec_splat_u8(0);
+
+	for(; len > 0 && ((long)p & 15); len--)
+		*p++ = 0;
+	for(; len >= 16; len -= 16, p += 16)
+		vec_st(zero, 0, p);
+	for(; len > 0; len--)
+		*p++ = 0;
+}
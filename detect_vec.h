@@ -0,0 +1,16 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+#ifndef __DETECT_VEC_H__
+#define __DETECT_VEC_H__
+
+// AltiVec versions of the detection kernels. detect_vec.c is the only
+// file built for the G4; main picks these at startup if Gestalt says
+// the CPU has vector instructions, so 601-G3 machines never run them.
+
+#include "detect.h"
+
+Boolean MatchVector(const Byte *p, const char *magic, short len);
+void ClearVector(Byte *p, long len);
+
+#endif
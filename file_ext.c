@@ -5,9 +5,12 @@
 #include "file_ext.h"
 #include <stdbool.h>
 
-// Simple file ext checks as fallback.
+// Simple file ext checks as fallback. Extensions are stored inline so
+// a lookup walks one 16 byte entry after another instead of chasing a
+// pointer per entry; the keys that get compared stay together in the
+// cache, which matters on a 68040.
 static const struct {
-	char *extension;
+	char extension[8];
 	OSType type;
 	OSType creator;
 } exttypes[] = {
@@ -326,4 +329,15 @@ Boolean CheckFileExt(const char *ext, OSType *type, OSType *creator)
 		}
 	}
 	return false;
-}
\ No newline at end of file
+}
+
+const char *FileExtAt(short index, OSType *type, OSType *creator)
+{
+	if(index < 0 || index >= (short)(sizeof(exttypes) / sizeof(exttypes[0])))
+		return nil;
+	if(type)
+		*type = exttypes[index].type;
+	if(creator)
+		*creator = exttypes[index].creator;
+	return exttypes[index].extension;
+}
@@ -5,4 +5,7 @@
 #include <MacTypes.h>
 
 Boolean
-CheckFileExt(const char *ext, OSType *type, OSType *creator);
\ No newline at end of file
+CheckFileExt(const char *ext, OSType *type, OSType *creator);
+// The index'th extension in the table and, if type and creator aren't
+// nil, what it maps to. nil past the end.
+const char *FileExtAt(short index, OSType *type, OSType *creator);
\ No newline at end of file
@@ -0,0 +1,40 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+#ifndef __MACTYPES__
+#define __MACTYPES__
+
+// Just enough of the Universal Interfaces types for the detection core to
+// build on the host. Only the host tools put this directory on the
+// include path; the Mac build always gets the real MacTypes.h.
+
+#include <stdint.h>
+
+typedef uint8_t UInt8;
+typedef int8_t SInt8;
+typedef uint16_t UInt16;
+typedef int16_t SInt16;
+typedef uint32_t UInt32;
+typedef int32_t SInt32;
+typedef uint64_t UInt64;
+typedef int64_t SInt64;
+
+typedef unsigned char Byte;
+typedef unsigned char Boolean;
+typedef char *Ptr;
+typedef SInt16 OSErr;
+typedef UInt32 FourCharCode;
+typedef FourCharCode OSType;
+typedef unsigned char Str255[256];
+typedef unsigned char Str63[64];
+typedef unsigned char Str31[32];
+
+#ifndef nil
+#define nil 0
+#endif
+
+enum {
+	noErr = 0
+};
+
+#endif
@@ -0,0 +1,822 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+
+// archive mode: rewrite a tar or zip so each member carries its Finder
+// type/creator, without extracting anything. Tar members get a PAX
+// SCHILY.xattr.com.apple.FinderInfo record, the way bsdtar and GNU tar
+// store xattrs. Zip members get a __MACOSX/._name AppleDouble entry,
+// the way the Finder's own Compress does it. Only the first SNIFF_SIZE
+// bytes of each member are read into memory; the rest is moved with
+// CopyRange.
+
+#include "host.h"
+#include "io.h"
+#include "macroman.h"
+#include "../detect.h"
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef FAF_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#define kTarBlock 512
+#define kMaxMeta 65536
+#define kFinderInfoKey "SCHILY.xattr.com.apple.FinderInfo"
+
+#define kZipLocalSig 0x04034b50
+#define kZipCentralSig 0x02014b50
+#define kZipEndSig 0x06054b50
+#define kAppleDoubleSize 82
+
+typedef struct {
+	int in;
+	int out;
+	SniffRec sniff;
+	long members;
+	long stamped;
+	long unknown;
+	ResultLog *log;
+} ArchiveJob;
+
+// Classifies one member from its path and the bytes already in
+// job->sniff. Only verdicts that would actually be written count.
+static Boolean SniffMember(ArchiveJob *job, const char *path)
+{
+	unsigned char pName[256];
+	const char *base = strrchr(path, '/');
+	char oType[5], oCreator[5];
+	UInt32 start = HostMicros();
+	ResultRec rec = {0};
+	Boolean found;
+
+	base = base ? base + 1 : path;
+	UTF8ToMacRoman(base, pName);
+	SniffPad(&job->sniff);
+	found = SniffFile(&job->sniff, pName) && job->sniff.type != 0 && job->sniff.creator != 0;
+
+	job->members++;
+	if(job->log)
+	{
+		rec.path = path;
+		rec.fileID = job->members;
+		rec.newType = found ? job->sniff.type : 0;
+		rec.newCreator = found ? job->sniff.creator : 0;
+		rec.detector = job->sniff.detector;
+		rec.micros = HostMicros() - start;
+		ResultLogAppend(job->log, &rec);
+	}
+	if(found)
+	{
+		job->stamped++;
+		FormatOSType(job->sniff.type, oType);
+		FormatOSType(job->sniff.creator, oCreator);
+		fprintf(stderr, "%s\t%s/%s\t%s\n", path, oType, oCreator, DetectorName(job->sniff.detector));
+	}
+	else
+	{
+		job->unknown++;
+		fprintf(stderr, "%s\tunknown\n", path);
+	}
+	return found;
+}
+
+static void FinderInfoFor(SniffRec *s, Byte *finfo)
+{
+	Put32BE(finfo, s->type);
+	Put32BE(finfo + 4, s->creator);
+}
+
+// tar
+
+// Tar numbers are octal text, or GNU base-256 when the top bit is set.
+static UInt64 TarNumber(const Byte *p, short len)
+{
+	UInt64 v = 0;
+	short i;
+
+	if(p[0] & 0x80)
+	{
+		v = p[0] & 0x7F;
+		for(i = 1; i < len; i++)
+			v = (v << 8) | p[i];
+		return v;
+	}
+	for(i = 0; i < len && (p[i] == ' ' || p[i] == 0); i++);
+	for(; i < len && p[i] >= '0' && p[i] <= '7'; i++)
+		v = (v << 3) | (p[i] - '0');
+	return v;
+}
+
+static void TarChecksum(Byte *h)
+{
+	UInt32 sum = 0;
+	short i;
+
+	memset(h + 148, ' ', 8);
+	for(i = 0; i < kTarBlock; i++)
+		sum += h[i];
+	snprintf((char *)h + 148, 8, "%06o", sum);
+	h[155] = ' ';
+}
+
+// A ustar (POSIX or GNU) header whose checksum adds up. The sum is
+// unsigned, but some old tars summed signed bytes, so either is fine.
+static Boolean IsTarHeader(const Byte *h)
+{
+	UInt32 sum = 0;
+	SInt32 ssum = 0;
+	UInt64 want;
+	short i;
+
+	if(memcmp(h + 257, "ustar", 5) != 0)
+		return false;
+	for(i = 0; i < kTarBlock; i++)
+	{
+		Byte c = (i >= 148 && i < 156) ? ' ' : h[i];
+		sum += c;
+		ssum += (signed char)c;
+	}
+	want = TarNumber(h + 148, 8);
+	return want == sum || want == (UInt64)(UInt32)ssum;
+}
+
+static Boolean IsZeroBlock(const Byte *h)
+{
+	short i;
+	for(i = 0; i < kTarBlock; i++)
+		if(h[i])
+			return false;
+	return true;
+}
+
+// Finds key in a block of "len key=value\n" records.
+static Boolean PaxFind(const Byte *pax, long len, const char *key, const Byte **val, long *valLen)
+{
+	long off = 0, recLen, keyLen = strlen(key);
+	const Byte *rec, *eq;
+
+	while(off < len)
+	{
+		rec = pax + off;
+		recLen = strtol((const char *)rec, nil, 10);
+		if(recLen <= 0 || off + recLen > len)
+			return false;
+		eq = memchr(rec, ' ', recLen);
+		if(eq && recLen - (eq + 1 - rec) > keyLen && memcmp(eq + 1, key, keyLen) == 0 && eq[1 + keyLen] == '=')
+		{
+			*val = eq + 2 + keyLen;
+			*valLen = rec + recLen - 1 - *val;
+			return true;
+		}
+		off += recLen;
+	}
+	return false;
+}
+
+// Appends one record; the length prefix counts its own digits.
+static long PaxPut(Byte *pax, long len, const char *key, const Byte *val, long valLen)
+{
+	long body = strlen(key) + valLen + 3, total = body + 1, digits;
+	char prefix[24];
+
+	for(;;)
+	{
+		digits = snprintf(prefix, sizeof(prefix), "%ld", total);
+		if(body + digits == total)
+			break;
+		total = body + digits;
+	}
+	if(len + total > kMaxMeta)
+		return -1;
+	len += sprintf((char *)pax + len, "%s %s=", prefix, key);
+	memcpy(pax + len, val, valLen);
+	len += valLen;
+	pax[len++] = '\n';
+	return len;
+}
+
+static int TarWritePadded(ArchiveJob *job, const Byte *data, long len)
+{
+	static const Byte zeros[kTarBlock];
+	long pad = (kTarBlock - len % kTarBlock) % kTarBlock;
+	if(WriteAll(job->out, data, len))
+		return -1;
+	return WriteAll(job->out, zeros, pad);
+}
+
+// Writes the member's PAX header: everything the original one had,
+// with the FinderInfo record replaced.
+static int TarWritePax(ArchiveJob *job, const Byte *member, const char *path, const Byte *pax, long paxLen)
+{
+	Byte hdr[kTarBlock], finfo[32] = {0}, *out;
+	const Byte *old;
+	long off = 0, recLen, oldLen, outLen = 0;
+	const char *base = strrchr(path, '/');
+	int err;
+
+	out = malloc(kMaxMeta);
+	if(!out)
+		return -1;
+	if(PaxFind(pax, paxLen, kFinderInfoKey, &old, &oldLen) && oldLen == 32)
+		memcpy(finfo, old, 32);
+	FinderInfoFor(&job->sniff, finfo);
+
+	while(off < paxLen)
+	{
+		recLen = strtol((const char *)pax + off, nil, 10);
+		if(recLen <= 0 || off + recLen > paxLen)
+			break;
+		if(!PaxFind(pax + off, recLen, kFinderInfoKey, &old, &oldLen))
+		{
+			memcpy(out + outLen, pax + off, recLen);
+			outLen += recLen;
+		}
+		off += recLen;
+	}
+	outLen = PaxPut(out, outLen, kFinderInfoKey, finfo, 32);
+	if(outLen < 0)
+	{
+		free(out);
+		return -1;
+	}
+
+	memset(hdr, 0, sizeof(hdr));
+	snprintf((char *)hdr, 100, "PaxHeaders/%.88s", base ? base + 1 : path);
+	memcpy(hdr + 100, "0000644", 8);
+	memcpy(hdr + 108, "0000000", 8);
+	memcpy(hdr + 116, "0000000", 8);
+	snprintf((char *)hdr + 124, 12, "%011lo", outLen);
+	memcpy(hdr + 136, member + 136, 12);
+	hdr[156] = 'x';
+	memcpy(hdr + 257, "ustar", 6);
+	memcpy(hdr + 263, "00", 2);
+	TarChecksum(hdr);
+
+	err = WriteAll(job->out, hdr, kTarBlock);
+	if(!err)
+		err = TarWritePadded(job, out, outLen);
+	free(out);
+	return err;
+}
+
+// Reads a meta header's data into buf (padded to a block); buf holds
+// kMaxMeta. Longer meta data is an error rather than unbounded memory.
+static long TarReadMeta(ArchiveJob *job, UInt64 size, Byte *buf)
+{
+	long padded = (size + kTarBlock - 1) / kTarBlock * kTarBlock;
+	if(size >= kMaxMeta)
+		return -1;
+	if(ReadFull(job->in, buf, padded) != padded)
+		return -1;
+	buf[size] = 0;
+	return size;
+}
+
+static int TarRewrite(ArchiveJob *job, const Byte *first)
+{
+	Byte hdr[kTarBlock], paxHdr[kTarBlock];
+	Byte *pax = malloc(kMaxMeta), *pend = malloc(kMaxMeta), *name = malloc(kMaxMeta);
+	long paxLen = -1, pendLen = 0, nameLen = -1, metaLen, sniffed;
+	char path[kMaxMeta / 2];
+	const Byte *val;
+	long valLen;
+	UInt64 size;
+	Byte type;
+	ssize_t n;
+	int err = -1;
+
+	if(!pax || !pend || !name)
+		goto done;
+	memcpy(hdr, first, kTarBlock);
+	for(;;)
+	{
+		if(IsZeroBlock(hdr))
+		{
+			// End of archive: pass the trailer through untouched.
+			if(WriteAll(job->out, hdr, kTarBlock))
+				goto done;
+			while((n = ReadFull(job->in, hdr, kTarBlock)) > 0)
+				if(WriteAll(job->out, hdr, n))
+					goto done;
+			err = n < 0 ? -1 : 0;
+			goto done;
+		}
+		if(!IsTarHeader(hdr))
+			goto done;
+		type = hdr[156];
+		size = TarNumber(hdr + 124, 12);
+
+		if(type == 'x')
+		{
+			memcpy(paxHdr, hdr, kTarBlock);
+			paxLen = TarReadMeta(job, size, pax);
+			if(paxLen < 0)
+				goto done;
+		}
+		else if(type == 'L' || type == 'K')
+		{
+			// GNU long names: keep the blocks to re-emit, and the name.
+			// The header, the padded data and TarReadMeta's NUL must all
+			// fit before anything is read.
+			if(size >= kMaxMeta || pendLen + 2 * kTarBlock + (long)((size + kTarBlock - 1) / kTarBlock * kTarBlock) > kMaxMeta)
+				goto done;
+			metaLen = TarReadMeta(job, size, pend + pendLen + kTarBlock);
+			if(metaLen < 0)
+				goto done;
+			memcpy(pend + pendLen, hdr, kTarBlock);
+			if(type == 'L')
+			{
+				memcpy(name, pend + pendLen + kTarBlock, metaLen + 1);
+				nameLen = metaLen;
+			}
+			pendLen += kTarBlock + (metaLen + kTarBlock - 1) / kTarBlock * kTarBlock;
+		}
+		else if(type == 'g')
+		{
+			// Global headers apply to everything after; pass through.
+			if(WriteAll(job->out, hdr, kTarBlock) || CopyRange(job->in, nil, job->out, (size + kTarBlock - 1) / kTarBlock * kTarBlock))
+				goto done;
+		}
+		else
+		{
+			if(paxLen >= 0 && PaxFind(pax, paxLen, "size", &val, &valLen))
+				size = strtoull((const char *)val, nil, 10);
+			if(paxLen >= 0 && PaxFind(pax, paxLen, "path", &val, &valLen) && valLen < (long)sizeof(path))
+			{
+				memcpy(path, val, valLen);
+				path[valLen] = 0;
+			}
+			else if(nameLen >= 0)
+				snprintf(path, sizeof(path), "%s", name);
+			else if(hdr[345] && memcmp(hdr + 257, "ustar", 5) == 0)
+				snprintf(path, sizeof(path), "%.155s/%.100s", hdr + 345, hdr);
+			else
+				snprintf(path, sizeof(path), "%.100s", hdr);
+
+			sniffed = 0;
+			if(type == '0' || type == 0 || type == '7')
+			{
+				sniffed = size < SNIFF_SIZE ? size : SNIFF_SIZE;
+				if(ReadFull(job->in, job->sniff.buf, sniffed) != sniffed)
+					goto done;
+				job->sniff.count = sniffed;
+			}
+
+			if(WriteAll(job->out, pend, pendLen))
+				goto done;
+			if((type == '0' || type == 0 || type == '7') && SniffMember(job, path))
+			{
+				if(TarWritePax(job, hdr, path, pax, paxLen < 0 ? 0 : paxLen))
+					goto done;
+			}
+			else if(paxLen >= 0)
+			{
+				if(WriteAll(job->out, paxHdr, kTarBlock) || TarWritePadded(job, pax, paxLen))
+					goto done;
+			}
+			if(WriteAll(job->out, hdr, kTarBlock) || WriteAll(job->out, job->sniff.buf, sniffed))
+				goto done;
+			if(CopyRange(job->in, nil, job->out, size - sniffed + (kTarBlock - size % kTarBlock) % kTarBlock))
+				goto done;
+			paxLen = -1;
+			pendLen = 0;
+			nameLen = -1;
+		}
+
+		n = ReadFull(job->in, hdr, kTarBlock);
+		if(n == 0)
+		{
+			// No end-of-archive blocks; accept it like tar does.
+			err = 0;
+			goto done;
+		}
+		if(n != kTarBlock)
+			goto done;
+	}
+
+done:
+	free(pax);
+	free(pend);
+	free(name);
+	return err;
+}
+
+// zip
+
+static UInt16 Get16LE(const Byte *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static UInt32 Get32LE(const Byte *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((UInt32)p[3] << 24);
+}
+
+static void Put16LE(Byte *p, UInt16 v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static void Put32LE(Byte *p, UInt32 v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static UInt32 Crc32(const Byte *p, long len)
+{
+	static UInt32 table[256];
+	UInt32 c;
+	long i;
+	short k;
+
+	if(!table[1])
+	{
+		for(i = 0; i < 256; i++)
+		{
+			c = i;
+			for(k = 0; k < 8; k++)
+				c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+			table[i] = c;
+		}
+	}
+	c = 0xFFFFFFFF;
+	for(i = 0; i < len; i++)
+		c = table[(c ^ p[i]) & 0xFF] ^ (c >> 8);
+	return c ^ 0xFFFFFFFF;
+}
+
+static UInt64 HashName(const Byte *p, long len)
+{
+	UInt64 h = 0xcbf29ce484222325ULL;
+	long i;
+	for(i = 0; i < len; i++)
+		h = (h ^ p[i]) * 0x100000001b3ULL;
+	return h;
+}
+
+static int CompareHashes(const void *a, const void *b)
+{
+	UInt64 l = *(const UInt64 *)a, r = *(const UInt64 *)b;
+	return (l > r) - (l < r);
+}
+
+typedef struct {
+	UInt64 *hashes;
+	long count;
+	long max;
+} HashSet;
+
+static int HashAdd(HashSet *set, UInt64 h)
+{
+	UInt64 *grown;
+	if(set->count == set->max)
+	{
+		set->max = set->max ? set->max * 2 : 64;
+		grown = realloc(set->hashes, sizeof(UInt64) * set->max);
+		if(!grown)
+			return -1;
+		set->hashes = grown;
+	}
+	set->hashes[set->count++] = h;
+	return 0;
+}
+
+static Boolean HashHas(HashSet *set, UInt64 h)
+{
+	return set->count && bsearch(&h, set->hashes, set->count, sizeof(UInt64), CompareHashes);
+}
+
+// Reads the central directory record at *off: the fixed part into rec,
+// the name into name. Advances *off past the record.
+static long ZipReadCentral(ArchiveJob *job, off_t *off, Byte *rec, Byte *name)
+{
+	UInt16 nameLen;
+	long recLen;
+
+	if(pread(job->in, rec, 46, *off) != 46 || Get32LE(rec) != kZipCentralSig)
+		return -1;
+	nameLen = Get16LE(rec + 28);
+	if(pread(job->in, name, nameLen, *off + 46) != nameLen)
+		return -1;
+	name[nameLen] = 0;
+	recLen = 46 + nameLen + Get16LE(rec + 30) + Get16LE(rec + 32);
+	*off += recLen;
+	return recLen;
+}
+
+// Fills job->sniff with the start of a member's uncompressed data.
+static void ZipSniffData(ArchiveJob *job, const Byte *rec)
+{
+	Byte local[30];
+	off_t dataOff;
+	UInt32 csize = Get32LE(rec + 20);
+	UInt16 method = Get16LE(rec + 10);
+	long want;
+
+	job->sniff.count = 0;
+	if(pread(job->in, local, 30, Get32LE(rec + 42)) != 30 || Get32LE(local) != kZipLocalSig)
+		return;
+	dataOff = Get32LE(rec + 42) + 30 + Get16LE(local + 26) + Get16LE(local + 28);
+
+	if(method == 0)
+	{
+		want = csize < SNIFF_SIZE ? csize : SNIFF_SIZE;
+		job->sniff.count = pread(job->in, job->sniff.buf, want, dataOff);
+	}
+#ifdef FAF_HAVE_ZLIB
+	else if(method == 8)
+	{
+		// Inflate just enough for the detectors.
+		Byte in[4096];
+		z_stream z;
+		ssize_t n;
+		int zerr = Z_OK;
+
+		memset(&z, 0, sizeof(z));
+		if(inflateInit2(&z, -MAX_WBITS) != Z_OK)
+			return;
+		z.next_out = job->sniff.buf;
+		z.avail_out = SNIFF_SIZE;
+		while(z.avail_out && zerr == Z_OK && csize)
+		{
+			n = pread(job->in, in, csize < sizeof(in) ? csize : sizeof(in), dataOff);
+			if(n <= 0)
+				break;
+			dataOff += n;
+			csize -= n;
+			z.next_in = in;
+			z.avail_in = n;
+			zerr = inflate(&z, Z_NO_FLUSH);
+		}
+		job->sniff.count = SNIFF_SIZE - z.avail_out;
+		inflateEnd(&z);
+	}
+#endif
+	// Other methods are classified by name only.
+}
+
+static void AppleDoubleFor(SniffRec *s, Byte *ad)
+{
+	memset(ad, 0, kAppleDoubleSize);
+	Put32BE(ad, 0x00051607);
+	Put32BE(ad + 4, 0x00020000);
+	memcpy(ad + 8, "Mac OS X        ", 16);
+	ad[25] = 2;
+	// Entry 9 is the FinderInfo, entry 2 an empty resource fork.
+	Put32BE(ad + 26, 9);
+	Put32BE(ad + 30, 50);
+	Put32BE(ad + 34, 32);
+	Put32BE(ad + 38, 2);
+	Put32BE(ad + 42, kAppleDoubleSize);
+	Put32BE(ad + 46, 0);
+	FinderInfoFor(s, ad + 50);
+}
+
+static int ZipRewrite(ArchiveJob *job)
+{
+	Byte tail[65557], rec[46], *name = malloc(65536 + 32), *adName = malloc(65536 + 32);
+	Byte ad[kAppleDoubleSize], hdr[46], end[22];
+	struct stat st;
+	off_t tailOff, cdOff, off, outPos;
+	long tailLen, eocd, i, recLen, count, newCount = 0, baseLen;
+	UInt32 cdSize, newCdSize = 0, crc;
+	UInt16 nameLen, adLen, commentLen;
+	HashSet existing = {0}, replaced = {0};
+	FILE *spool = nil;
+	Byte *base;
+	size_t n;
+	int err = -1;
+
+	if(!name || !adName || fstat(job->in, &st))
+		goto done;
+	tailLen = st.st_size < (off_t)sizeof(tail) ? st.st_size : (long)sizeof(tail);
+	tailOff = st.st_size - tailLen;
+	if(pread(job->in, tail, tailLen, tailOff) != tailLen)
+		goto done;
+	for(eocd = tailLen - 22; eocd >= 0; eocd--)
+		if(Get32LE(tail + eocd) == kZipEndSig && eocd + 22 + Get16LE(tail + eocd + 20) == tailLen)
+			break;
+	if(eocd < 0)
+	{
+		fprintf(stderr, "archive: no zip end of central directory\n");
+		goto done;
+	}
+	count = Get16LE(tail + eocd + 10);
+	cdSize = Get32LE(tail + eocd + 12);
+	cdOff = Get32LE(tail + eocd + 16);
+	commentLen = Get16LE(tail + eocd + 20);
+	if(count == 0xFFFF || cdOff == 0xFFFFFFFF || cdSize == 0xFFFFFFFF)
+	{
+		fprintf(stderr, "archive: zip64 archives aren't supported\n");
+		goto done;
+	}
+
+	// Entries and their data stay exactly where they were.
+	off = 0;
+	if(CopyRange(job->in, &off, job->out, cdOff))
+		goto done;
+	outPos = cdOff;
+
+	// AppleDouble entries already in the archive get superseded.
+	off = cdOff;
+	for(i = 0; i < count; i++)
+	{
+		if(ZipReadCentral(job, &off, rec, name) < 0)
+			goto done;
+		nameLen = Get16LE(rec + 28);
+		if(nameLen > 9 && memcmp(name, "__MACOSX/", 9) == 0 && HashAdd(&existing, HashName(name, nameLen)))
+			goto done;
+	}
+	qsort(existing.hashes, existing.count, sizeof(UInt64), CompareHashes);
+
+	spool = tmpfile();
+	if(!spool)
+		goto done;
+	off = cdOff;
+	for(i = 0; i < count; i++)
+	{
+		if(ZipReadCentral(job, &off, rec, name) < 0)
+			goto done;
+		nameLen = Get16LE(rec + 28);
+		if(nameLen == 0 || name[nameLen - 1] == '/' || (nameLen > 9 && memcmp(name, "__MACOSX/", 9) == 0))
+			continue;
+		ZipSniffData(job, rec);
+		if(!SniffMember(job, (char *)name))
+			continue;
+
+		// __MACOSX/dir/._base
+		base = (Byte *)strrchr((char *)name, '/');
+		base = base ? base + 1 : name;
+		baseLen = nameLen - (base - name);
+		if(9 + nameLen + 2 > 65535)
+			continue;
+		memcpy(adName, "__MACOSX/", 9);
+		memcpy(adName + 9, name, base - name);
+		memcpy(adName + 9 + (base - name), "._", 2);
+		memcpy(adName + 9 + (base - name) + 2, base, baseLen);
+		adLen = 9 + nameLen + 2;
+		if(HashHas(&existing, HashName(adName, adLen)) && HashAdd(&replaced, HashName(adName, adLen)))
+			goto done;
+
+		AppleDoubleFor(&job->sniff, ad);
+		crc = Crc32(ad, kAppleDoubleSize);
+		memset(hdr, 0, sizeof(hdr));
+		Put32LE(hdr, kZipLocalSig);
+		Put16LE(hdr + 4, 10);
+		Put16LE(hdr + 6, Get16LE(rec + 8) & 0x0800);	// keep the UTF-8 name flag
+		memcpy(hdr + 10, rec + 12, 4);					// DOS time and date
+		Put32LE(hdr + 14, crc);
+		Put32LE(hdr + 18, kAppleDoubleSize);
+		Put32LE(hdr + 22, kAppleDoubleSize);
+		Put16LE(hdr + 26, adLen);
+		if(WriteAll(job->out, hdr, 30) || WriteAll(job->out, adName, adLen) || WriteAll(job->out, ad, kAppleDoubleSize))
+			goto done;
+
+		memset(hdr, 0, sizeof(hdr));
+		Put32LE(hdr, kZipCentralSig);
+		Put16LE(hdr + 4, 20);
+		Put16LE(hdr + 6, 10);
+		Put16LE(hdr + 8, Get16LE(rec + 8) & 0x0800);
+		memcpy(hdr + 12, rec + 12, 4);
+		Put32LE(hdr + 16, crc);
+		Put32LE(hdr + 20, kAppleDoubleSize);
+		Put32LE(hdr + 24, kAppleDoubleSize);
+		Put16LE(hdr + 28, adLen);
+		Put32LE(hdr + 42, outPos);
+		if(fwrite(hdr, 46, 1, spool) != 1 || fwrite(adName, adLen, 1, spool) != 1)
+			goto done;
+		outPos += 30 + adLen + kAppleDoubleSize;
+		newCdSize += 46 + adLen;
+		newCount++;
+	}
+	qsort(replaced.hashes, replaced.count, sizeof(UInt64), CompareHashes);
+
+	// Original central directory, minus superseded AppleDouble entries,
+	// then the new ones.
+	off = cdOff;
+	cdOff = outPos;
+	for(i = 0; i < count; i++)
+	{
+		off_t recOff = off;
+		recLen = ZipReadCentral(job, &off, rec, name);
+		if(recLen < 0)
+			goto done;
+		nameLen = Get16LE(rec + 28);
+		if(HashHas(&replaced, HashName(name, nameLen)))
+			continue;
+		if(CopyRange(job->in, &recOff, job->out, recLen))
+			goto done;
+		newCdSize += recLen;
+		newCount++;
+	}
+	rewind(spool);
+	while((n = fread(tail, 1, sizeof(tail), spool)) > 0)
+		if(WriteAll(job->out, tail, n))
+			goto done;
+
+	if(newCount > 0xFFFF)
+	{
+		fprintf(stderr, "archive: too many entries for a non-zip64 archive\n");
+		goto done;
+	}
+	memset(end, 0, sizeof(end));
+	Put32LE(end, kZipEndSig);
+	Put16LE(end + 8, newCount);
+	Put16LE(end + 10, newCount);
+	Put32LE(end + 12, newCdSize);
+	Put32LE(end + 16, cdOff);
+	Put16LE(end + 20, commentLen);
+	off = st.st_size - commentLen;
+	if(WriteAll(job->out, end, 22) || CopyRange(job->in, &off, job->out, commentLen))
+		goto done;
+	err = 0;
+
+done:
+	if(spool)
+		fclose(spool);
+	free(existing.hashes);
+	free(replaced.hashes);
+	free(name);
+	free(adName);
+	return err;
+}
+
+int ArchiveMain(int argc, char **argv)
+{
+	ArchiveJob job;
+	Byte first[kTarBlock];
+	const char *outPath = nil;
+	ssize_t n;
+	int ch, err;
+
+	memset(&job, 0, sizeof(job));
+	while((ch = getopt(argc, argv, "o:r:")) != -1)
+	{
+		switch(ch)
+		{
+			case 'o':
+				outPath = optarg;
+				break;
+			case 'r':
+				job.log = OpenResultLog(optarg);
+				if(!job.log)
+					return 1;
+				break;
+			default:
+				fprintf(stderr, "usage: fix-a-fork-host archive [-o out] [-r log] [archive]\n");
+				return 2;
+		}
+	}
+	job.in = 0;
+	if(optind < argc && (job.in = open(argv[optind], O_RDONLY)) < 0)
+	{
+		perror(argv[optind]);
+		return 1;
+	}
+	job.out = 1;
+	if(outPath && (job.out = open(outPath, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+	{
+		perror(outPath);
+		return 1;
+	}
+
+	n = ReadFull(job.in, first, kTarBlock);
+	if(n >= 4 && Get32LE(first) == kZipLocalSig)
+	{
+		// The zip central directory is at the end, so the input has to
+		// be seekable; the output is still written front to back.
+		if(lseek(job.in, 0, SEEK_SET) != 0)
+		{
+			fprintf(stderr, "archive: zip input must be a file, not a pipe\n");
+			return 1;
+		}
+		err = ZipRewrite(&job);
+	}
+	else if(n == kTarBlock && IsTarHeader(first))
+		err = TarRewrite(&job, first);
+	else
+	{
+		fprintf(stderr, "archive: not a tar or zip archive\n");
+		return 1;
+	}
+
+	if(err)
+		fprintf(stderr, "archive: damaged archive or write error\n");
+	fprintf(stderr, "%ld members, %ld stamped, %ld unknown\n", job.members, job.stamped, job.unknown);
+	if(outPath && close(job.out))
+		err = -1;
+	if(CloseResultLog(job.log))
+		err = -1;
+	return err ? 1 : 0;
+}
@@ -0,0 +1,328 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+
+// fix-a-fork-bench: end-to-end throughput of the detection path.
+//
+//	gen [-n count] [-s min:max] [-x seed] dir
+//		writes a corpus: every header signature, every extension in the
+//		table, unknown binaries and plain text, in equal turns, sizes
+//		log-uniform between min and max. Each file is checked against
+//		the detector it was made for as it's written.
+//	run [-w passes] dir...
+//		walks and classifies the trees the way pipe mode does (open,
+//		fstat, one pread of SNIFF_SIZE, close), once with the files
+//		evicted from the page cache and then warm, and reports files/s,
+//		bytes read and system calls per file.
+//
+// Every optimization of the host tools should be judged against run.
+
+#define _GNU_SOURCE
+#include "corpus.h"
+#include "io.h"
+#include "macroman.h"
+#include "../detect.h"
+#include "../file_ext.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define kFilesPerDir 1000
+#define kMaxFileSize (16L * 1024 * 1024)
+#define kDirBufSize 32768
+
+typedef struct {
+	long files;
+	long syscalls;
+	long long bytes;
+	long unknown;
+	long errors;
+} Counts;
+
+static Counts gCounts;
+
+static double Seconds()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long LogUniform(long min, long max)
+{
+	double r = (double)CorpusRandom() / 4294967296.0;
+	if(max <= min)
+		return min;
+	return (long)(min * exp(r * log((double)max / min)));
+}
+
+static int WriteFile(const char *path, const Byte *buf, long len)
+{
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+	if(fd < 0 || WriteAll(fd, buf, len) || close(fd))
+	{
+		perror(path);
+		return -1;
+	}
+	return 0;
+}
+
+static int GenMain(int argc, char **argv)
+{
+	long count = 10000, min = 512, max = 262144, i, size, unreachable = 0;
+	short kind, kinds, exts;
+	char path[4096], name[64];
+	unsigned char pName[256];
+	const char *ext;
+	Byte *buf;
+	SniffRec s;
+	int ch;
+
+	while((ch = getopt(argc, argv, "n:s:x:")) != -1)
+	{
+		switch(ch)
+		{
+			case 'n':
+				count = atol(optarg);
+				break;
+			case 's':
+				if(sscanf(optarg, "%ld:%ld", &min, &max) == 1)
+					max = min;
+				break;
+			case 'x':
+				CorpusSeed(strtoull(optarg, nil, 0));
+				break;
+			default:
+				goto usage;
+		}
+	}
+	if(optind != argc - 1 || count <= 0 || min < 1 || max > kMaxFileSize || min > max)
+		goto usage;
+	for(exts = 0; FileExtAt(exts, nil, nil); exts++)
+		;
+	kinds = kGenSignatures + exts + 2;
+	buf = malloc(max > SNIFF_SIZE ? max : SNIFF_SIZE);
+	if(!buf)
+		return 1;
+
+	snprintf(path, sizeof(path), "%s/", argv[optind]);
+	if(MakeParents(path))
+	{
+		perror(argv[optind]);
+		return 1;
+	}
+
+	for(i = 0; i < count; i++)
+	{
+		kind = i % kinds;
+		size = LogUniform(min, max);
+		ext = kind >= kGenSignatures && kind < kGenSignatures + exts ? FileExtAt(kind - kGenSignatures, nil, nil) : nil;
+		if(kind < kGenSignatures && size < SNIFF_SIZE)
+			size = SNIFF_SIZE;	// Disk Copy 6 looks at 1024
+		CorpusFill(buf, size, kind == kinds - 1);
+		if(kind < kGenSignatures)
+			CorpusSignature(buf, kind);
+
+		// No extension unless it's the point, and longer than 5 so the
+		// whole name isn't taken as one.
+		if(ext)
+			snprintf(name, sizeof(name), "file%06ld.%s", i, ext);
+		else
+			snprintf(name, sizeof(name), "file%06ld", i);
+		s.count = size < SNIFF_SIZE ? size : SNIFF_SIZE;
+		memcpy(s.buf, buf, s.count);
+		SniffPad(&s);
+		UTF8ToMacRoman(name, pName);
+		if(kind < kGenSignatures && (!SniffHeader(&s) || s.detector != kind))
+		{
+			fprintf(stderr, "gen: %s doesn't trip its detector, detect.c has moved on\n", name);
+			return 1;
+		}
+		// Some table entries can never match (longer than ParseFileExt
+		// reads, or not lower case); they stay in as unknowns.
+		if(ext && i < kinds && !SniffFile(&s, pName))
+			unreachable++;
+
+		snprintf(path, sizeof(path), "%s/d%03ld", argv[optind], i / kFilesPerDir);
+		if(i % kFilesPerDir == 0 && mkdir(path, 0755) && errno != EEXIST)
+		{
+			perror(path);
+			return 1;
+		}
+		snprintf(path, sizeof(path), "%s/d%03ld/%s", argv[optind], i / kFilesPerDir, name);
+		if(WriteFile(path, buf, size))
+			return 1;
+	}
+	free(buf);
+	fprintf(stderr, "%ld files, %d kinds (%d signatures, %d extensions, unknown, text)\n",
+		count, kinds, kGenSignatures, exts);
+	if(unreachable)
+		fprintf(stderr, "%ld extensions in the table can't be matched\n", unreachable);
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: fix-a-fork-bench gen [-n count] [-s min:max] [-x seed] dir\n");
+	return 2;
+}
+
+// pipe mode's ClassifyPath, against a directory fd.
+static void Classify(int dirFd, const char *name)
+{
+	unsigned char pName[256];
+	struct stat st;
+	SniffRec s;
+	int fd;
+
+	gCounts.files++;
+	gCounts.syscalls++;
+	fd = openat(dirFd, name, O_RDONLY | O_CLOEXEC);
+	if(fd < 0)
+	{
+		gCounts.errors++;
+		return;
+	}
+	gCounts.syscalls += 2;	// fstat, close
+	if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+	{
+		gCounts.syscalls++;
+		s.count = pread(fd, s.buf, SNIFF_SIZE, 0);
+		if(s.count < 0)
+			gCounts.errors++;
+		else
+		{
+			gCounts.bytes += s.count;
+			SniffPad(&s);
+			UTF8ToMacRoman(name, pName);
+			if(!SniffFile(&s, pName) || !s.type || !s.creator)
+				gCounts.unknown++;
+		}
+	}
+	close(fd);
+}
+
+// Walks with getdents64 directly, so every system call is counted.
+// evict drops each file from the page cache instead of classifying it.
+static void Walk(int dirFd, Boolean evict)
+{
+	char buf[kDirBufSize];
+	struct dirent64 *d;
+	long n, pos;
+	int sub, fd;
+
+	for(;;)
+	{
+		gCounts.syscalls++;
+		n = syscall(SYS_getdents64, dirFd, buf, sizeof(buf));
+		if(n <= 0)
+			break;
+		for(pos = 0; pos < n; pos += d->d_reclen)
+		{
+			d = (struct dirent64 *)(buf + pos);
+			if(strcmp(d->d_name, ".") == 0 || strcmp(d->d_name, "..") == 0)
+				continue;
+			if(d->d_type == DT_DIR)
+			{
+				gCounts.syscalls += 2;
+				sub = openat(dirFd, d->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+				if(sub >= 0)
+				{
+					Walk(sub, evict);
+					close(sub);
+				}
+			}
+			else if(!evict)
+				Classify(dirFd, d->d_name);
+			else if((fd = openat(dirFd, d->d_name, O_RDONLY | O_CLOEXEC)) >= 0)
+			{
+				posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+				close(fd);
+			}
+		}
+	}
+}
+
+static void Pass(const char *label, int argc, char **argv)
+{
+	double start;
+	int i, fd;
+
+	if(strcmp(label, "cold") == 0)
+	{
+		sync();
+		for(i = 0; i < argc; i++)
+			if((fd = open(argv[i], O_RDONLY | O_DIRECTORY | O_CLOEXEC)) >= 0)
+			{
+				Walk(fd, true);
+				close(fd);
+			}
+	}
+	memset(&gCounts, 0, sizeof(gCounts));
+	start = Seconds();
+	for(i = 0; i < argc; i++)
+	{
+		gCounts.syscalls += 2;
+		if((fd = open(argv[i], O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+		{
+			perror(argv[i]);
+			continue;
+		}
+		Walk(fd, false);
+		close(fd);
+	}
+	start = Seconds() - start;
+	if(!gCounts.files)
+		return;
+	printf("%-5s %9ld %9.3f %11.0f %11.1f %9.2f %8ld %7ld\n", label, gCounts.files, start,
+		gCounts.files / start, (double)gCounts.bytes / gCounts.files,
+		(double)gCounts.syscalls / gCounts.files, gCounts.unknown, gCounts.errors);
+}
+
+static int RunMain(int argc, char **argv)
+{
+	int ch, passes = 3, i;
+
+	while((ch = getopt(argc, argv, "w:")) != -1)
+	{
+		switch(ch)
+		{
+			case 'w':
+				passes = atoi(optarg);
+				break;
+			default:
+				goto usage;
+		}
+	}
+	if(optind == argc || passes < 0)
+		goto usage;
+	printf("pass      files      secs     files/s  bytes/file  sys/file  unknown  errors\n");
+	Pass("cold", argc - optind, argv + optind);
+	for(i = 0; i < passes; i++)
+		Pass("warm", argc - optind, argv + optind);
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: fix-a-fork-bench run [-w passes] dir...\n");
+	return 2;
+}
+
+int main(int argc, char **argv)
+{
+	if(argc >= 2 && strcmp(argv[1], "gen") == 0)
+		return GenMain(argc - 1, argv + 1);
+	if(argc >= 2 && strcmp(argv[1], "run") == 0)
+		return RunMain(argc - 1, argv + 1);
+	fprintf(stderr,
+		"usage: fix-a-fork-bench gen [-n count] [-s min:max] [-x seed] dir\n"
+		"       fix-a-fork-bench run [-w passes] dir...\n");
+	return 2;
+}
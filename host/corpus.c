@@ -0,0 +1,84 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+
+#include "corpus.h"
+#include "../detect.h"
+#include <string.h>
+
+static UInt64 gSeed = 0x9E3779B97F4A7C15ULL;
+
+void CorpusSeed(UInt64 seed)
+{
+	gSeed = seed | 1;
+}
+
+UInt32 CorpusRandom(void)
+{
+	gSeed ^= gSeed >> 12;
+	gSeed ^= gSeed << 25;
+	gSeed ^= gSeed >> 27;
+	return (gSeed * 0x2545F4914F6CDD1DULL) >> 32;
+}
+
+void CorpusSignature(Byte *buf, short kind)
+{
+	switch(kind)
+	{
+		case kGenBinHex:
+			memcpy(buf, "(This file must be converted with BinHex 4.0)\r", 46);
+			break;
+		case kGenSit15:
+			memcpy(buf, "SIT!", 4);
+			memcpy(buf + 10, "rLau", 4);
+			buf[14] = 0x02;
+			break;
+		case kGenSit5:
+			memcpy(buf, "StuffIt (c)1997-2002 Aladdin Systems, Inc.", 42);
+			buf[82] = 0x05;
+			break;
+		case kGenBinSit:
+			buf[0] = 0;
+			buf[1] = 12;
+			memcpy(buf + 2, "archive.sit", 11);
+			memcpy(buf + 128, "SIT!", 4);
+			memcpy(buf + 138, "rLau", 4);
+			buf[142] = 0x01;
+			break;
+		case kGenDsk4:
+			buf[0] = 6;
+			memcpy(buf + 1, "Volume", 6);
+			buf[52] = 0x01;
+			buf[53] = 0x00;
+			break;
+		case kGenDsk6:
+			buf[1024] = 'B';
+			buf[1025] = 'D';
+			break;
+		case kGenZip:
+			memcpy(buf, "PK\3\4", 4);
+			break;
+		case kGenMar:
+			memcpy(buf, "MAR", 3);
+			break;
+		case kGenCpt:
+			buf[0] = 1;
+			buf[1] = 1;
+			break;
+	}
+}
+
+void CorpusFill(Byte *buf, long len, Boolean text)
+{
+	static const char words[] = "the quick brown fox jumps over a lazy dog\r";
+	SniffRec s;
+	long i;
+
+	do {
+		for(i = 0; i < len; i++)
+			buf[i] = text ? (Byte)words[CorpusRandom() % (sizeof(words) - 1)] : (Byte)CorpusRandom();
+		s.count = len < SNIFF_SIZE ? len : SNIFF_SIZE;
+		memcpy(s.buf, buf, s.count);
+		SniffPad(&s);
+	} while(SniffHeader(&s));
+}
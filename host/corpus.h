@@ -0,0 +1,36 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+#ifndef __CORPUS_H__
+#define __CORPUS_H__
+
+// Synthetic file contents for the benchmarks (bench.c, micro.c).
+
+#include <MacTypes.h>
+
+// Kinds of file in the corpus, in the order gen hands them out: the
+// header signatures (numbered as in detect.c's table), then one per
+// extension, then the two that nothing should recognise.
+enum {
+	kGenBinHex,
+	kGenSit5,
+	kGenSit15,
+	kGenBinSit,
+	kGenDsk4,
+	kGenZip,
+	kGenMar,
+	kGenCpt,
+	kGenDsk6,
+	kGenSignatures
+};
+
+// xorshift64*, so a seed always gives the same corpus.
+void CorpusSeed(UInt64 seed);
+UInt32 CorpusRandom(void);
+// The header for kind, laid out exactly as its detector in detect.c
+// expects. buf must hold SNIFF_SIZE bytes.
+void CorpusSignature(Byte *buf, short kind);
+// Random bytes, or printable text, that no header detector takes.
+void CorpusFill(Byte *buf, long len, Boolean text);
+
+#endif
@@ -0,0 +1,398 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+
+// fix-a-fork-diff: holds the detection core to reference.c.
+//
+//	fix-a-fork-diff [-n fuzz] [-x seed] [-o dir] [path...]
+//
+// Every input is classified by the reference rules and by detect.c and
+// file_ext.c with each set of byte kernels that runs on this machine,
+// and the verdicts (found, detector, type, creator) must agree. The
+// inputs are every signature cut short at each offset that matters,
+// every extension in the table in both cases, -n fuzzed variants of
+// those, and the files under any paths given. Engine buffers start out
+// full of junk, so padding mistakes show up too.
+//
+// A mismatch is shrunk (fewer bytes, zeroed bytes, a shorter name)
+// while it still fails, and printed. With -o it's also written as a raw
+// record that fix-a-fork-host pipe -b reads. Exits 1 on any mismatch.
+
+#define _GNU_SOURCE
+#include "corpus.h"
+#include "macroman.h"
+#include "reference.h"
+#include "../detect.h"
+#include "../detect_68k.h"
+#include "../file_ext.h"
+#include <fcntl.h>
+#include <ftw.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define kMaxReports 10
+
+typedef struct {
+	Byte buf[SNIFF_SIZE];
+	long count;
+	unsigned char name[32];	// Pascal string, classic HFS length
+} Input;
+
+// detect.c's kernels; the AltiVec ones need a G4.
+static const struct {
+	const char *name;
+	MatchProc match;
+	ClearProc clear;
+} kEngines[] = {
+	{ "scalar", nil, nil },
+	{ "68k", MatchLongs, ClearLongs },
+};
+
+#define kNumEngines ((short)(sizeof(kEngines) / sizeof(kEngines[0])))
+
+// Offsets where a detector starts or stops looking; truncating there
+// is where padding bugs live.
+static const short kCuts[] = {
+	0, 1, 2, 3, 4, 5, 14, 15, 16, 34, 44, 45, 52, 53, 54, 82, 83,
+	128, 129, 132, 138, 142, 143, 144, 1023, 1024, 1025, 1026, SNIFF_SIZE - 1
+};
+
+static const char *gOutDir = nil;
+static long gInputs = 0;
+static long gMismatches = 0;
+static Input gFound;	// the file being read by Visit
+
+static void Engine(const Input *in, short engine, Verdict *v)
+{
+	SniffRec s;
+
+	DetectSetKernels(kEngines[engine].match, kEngines[engine].clear);
+	memset(s.buf, 0xA5, sizeof(s.buf));
+	memcpy(s.buf, in->buf, in->count);
+	s.count = in->count;
+	SniffPad(&s);
+	v->found = SniffFile(&s, in->name);
+	v->type = s.type;
+	v->creator = s.creator;
+	v->detector = s.detector;
+}
+
+static Boolean Same(const Verdict *a, const Verdict *b)
+{
+	return a->found == b->found && a->detector == b->detector && a->type == b->type && a->creator == b->creator;
+}
+
+// The first engine that disagrees with the reference, or -1.
+static short Check(const Input *in, Verdict *ref, Verdict *got)
+{
+	short i;
+
+	RefClassify(in->buf, in->count, in->name, ref);
+	for(i = 0; i < kNumEngines; i++)
+	{
+		Engine(in, i, got);
+		if(!Same(ref, got))
+			return i;
+	}
+	return -1;
+}
+
+// Keeps each cut that still fails: a shorter read, a zeroed byte, a
+// character dropped from the name.
+static void Shrink(Input *in)
+{
+	Verdict ref, got;
+	Input t;
+	long i;
+
+	for(t = *in, t.count = 0; t.count < in->count; t.count++)
+		if(Check(&t, &ref, &got) >= 0)
+		{
+			in->count = t.count;
+			break;
+		}
+	for(i = 0; i < in->count; i++)
+	{
+		if(!in->buf[i])
+			continue;
+		t = *in;
+		t.buf[i] = 0;
+		if(Check(&t, &ref, &got) >= 0)
+			*in = t;
+	}
+	for(i = 1; i <= in->name[0]; )
+	{
+		t = *in;
+		memmove(t.name + i, t.name + i + 1, t.name[0] - i);
+		t.name[0]--;
+		if(Check(&t, &ref, &got) >= 0)
+			*in = t;
+		else
+			i++;
+	}
+}
+
+static void PrintVerdict(const char *label, const Verdict *v)
+{
+	short i;
+
+	printf("  %-10s %s %-8s ", label, v->found ? "found" : "none ", DetectorName(v->detector));
+	for(i = 24; i >= 0; i -= 8)
+		putchar((v->type >> i & 0xFF) >= 0x20 && (v->type >> i & 0xFF) < 0x7F ? v->type >> i & 0xFF : '.');
+	putchar('/');
+	for(i = 24; i >= 0; i -= 8)
+		putchar((v->creator >> i & 0xFF) >= 0x20 && (v->creator >> i & 0xFF) < 0x7F ? v->creator >> i & 0xFF : '.');
+	putchar('\n');
+}
+
+// pipe -b's record: UInt16 nameLen, name, UInt32 dataLen, data.
+static void WriteRecord(const Input *in, const char *utf8)
+{
+	char path[4096];
+	Byte head[4];
+	size_t len = strlen(utf8);
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/mismatch-%ld.rec", gOutDir, gMismatches);
+	f = fopen(path, "wb");
+	if(!f)
+	{
+		perror(path);
+		return;
+	}
+	head[0] = len >> 8;
+	head[1] = len;
+	fwrite(head, 1, 2, f);
+	fwrite(utf8, 1, len, f);
+	head[0] = in->count >> 24;
+	head[1] = in->count >> 16;
+	head[2] = in->count >> 8;
+	head[3] = in->count;
+	fwrite(head, 1, 4, f);
+	fwrite(in->buf, 1, in->count, f);
+	if(fclose(f))
+		perror(path);
+	else
+		printf("  written to %s\n", path);
+}
+
+static void Report(Input *in, const char *source)
+{
+	char utf8[256];
+	Verdict ref, got;
+	short engine;
+	long i, run;
+
+	Shrink(in);
+	engine = Check(in, &ref, &got);
+	MacRomanToUTF8(in->name, utf8, sizeof(utf8));
+	printf("mismatch in %s engine, %s input, name \"%s\", %ld bytes\n", kEngines[engine].name, source, utf8, in->count);
+	PrintVerdict("reference", &ref);
+	PrintVerdict(kEngines[engine].name, &got);
+	// Only the bytes that are left: everything else is zero.
+	for(i = 0; i < in->count; i++)
+	{
+		if(!in->buf[i])
+			continue;
+		printf("  @%ld:", i);
+		for(run = 0; i < in->count && in->buf[i] && run < 16; i++, run++)
+			printf(" %02x", in->buf[i]);
+		putchar('\n');
+	}
+	if(gOutDir)
+		WriteRecord(in, utf8);
+}
+
+static void Try(Input *in, const char *source)
+{
+	Verdict ref, got;
+
+	gInputs++;
+	if(Check(in, &ref, &got) < 0)
+		return;
+	if(++gMismatches <= kMaxReports)
+		Report(in, source);
+}
+
+static void SetName(Input *in, const char *name)
+{
+	size_t len = strlen(name);
+
+	if(len > sizeof(in->name) - 1)
+		len = sizeof(in->name) - 1;
+	in->name[0] = len;
+	memcpy(in->name + 1, name, len);
+}
+
+static void RandomName(Input *in)
+{
+	static const char chars[] = "abcxyzABCXYZ0129 ._-";
+	short i, len = CorpusRandom() % 32;
+
+	in->name[0] = len;
+	for(i = 1; i <= len; i++)
+	{
+		if(CorpusRandom() % 8 == 0)
+			in->name[i] = 0x80 + CorpusRandom() % 0x80;
+		else
+			in->name[i] = chars[CorpusRandom() % (sizeof(chars) - 1)];
+	}
+}
+
+// Every signature over random bytes and text, cut at each offset that
+// matters, and every table extension on an unknown header.
+static void Generated()
+{
+	OSType type, creator;
+	const char *ext;
+	char name[64];
+	short kind, cut, i;
+	Input in;
+
+	for(kind = 0; kind < kGenSignatures; kind++)
+		for(i = 0; i < 2; i++)
+			for(cut = 0; cut < (short)(sizeof(kCuts) / sizeof(kCuts[0])) + 1; cut++)
+			{
+				CorpusFill(in.buf, SNIFF_SIZE, i);
+				CorpusSignature(in.buf, kind);
+				in.count = cut < (short)(sizeof(kCuts) / sizeof(kCuts[0])) ? kCuts[cut] : SNIFF_SIZE;
+				SetName(&in, "Archive");
+				Try(&in, "generated");
+				SetName(&in, "Archive.txt");
+				Try(&in, "generated");
+			}
+	for(i = 0; (ext = FileExtAt(i, &type, &creator)) != nil; i++)
+	{
+		CorpusFill(in.buf, SNIFF_SIZE, false);
+		in.count = SNIFF_SIZE;
+		snprintf(name, sizeof(name), "File.%s", ext);
+		SetName(&in, name);
+		Try(&in, "generated");
+		for(kind = 0; name[kind]; kind++)
+			if(name[kind] >= 'a' && name[kind] <= 'z')
+				name[kind] -= 'a' - 'A';
+		SetName(&in, name);
+		Try(&in, "generated");
+		SetName(&in, ext);
+		Try(&in, "generated");
+	}
+}
+
+// Signature headers with bytes flipped, magic bytes planted, signatures
+// moved, reads cut short and names scrambled.
+static void Fuzzed(long count)
+{
+	static const Byte planted[] = { 0x00, 0x01, 0x02, 0x05, 'S', 'I', 'T', '!', 'P', 'K', 'B', 'D', 'M', 'A', 'R' };
+	OSType type, creator;
+	const char *ext;
+	char name[64];
+	short exts, kind, n, at;
+	Input in;
+	long i;
+
+	for(exts = 0; FileExtAt(exts, nil, nil); exts++)
+		;
+	for(i = 0; i < count; i++)
+	{
+		kind = CorpusRandom() % (kGenSignatures + 1);
+		CorpusFill(in.buf, SNIFF_SIZE, CorpusRandom() & 1);
+		if(kind < kGenSignatures)
+			CorpusSignature(in.buf, kind);
+		in.count = SNIFF_SIZE;
+		ext = FileExtAt(CorpusRandom() % exts, &type, &creator);
+		snprintf(name, sizeof(name), "f%ld.%s", i, ext);
+		SetName(&in, name);
+		for(n = 1 + CorpusRandom() % 4; n > 0; n--)
+		{
+			// Most of the action is in the first block and just past 1024.
+			at = CorpusRandom() & 1 ? CorpusRandom() % 160 : BUF_SIZE - 2 + CorpusRandom() % 8;
+			switch(CorpusRandom() % 6)
+			{
+				case 0:
+					in.buf[at] ^= 1 << (CorpusRandom() % 8);
+					break;
+				case 1:
+					in.buf[at] = planted[CorpusRandom() % sizeof(planted)];
+					break;
+				case 2:
+					CorpusSignature(in.buf + CorpusRandom() % 256, CorpusRandom() % (kGenSignatures - 1));
+					break;
+				case 3:
+					in.count = CorpusRandom() % (SNIFF_SIZE + 1);
+					break;
+				case 4:
+					RandomName(&in);
+					break;
+				case 5:
+					if(in.name[0])
+						in.name[1 + CorpusRandom() % in.name[0]] ^= 0x20;
+					break;
+			}
+		}
+		Try(&in, "fuzzed");
+	}
+}
+
+static int Visit(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+	unsigned char pName[256];
+	int fd;
+
+	if(flag != FTW_F || !S_ISREG(st->st_mode))
+		return 0;
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if(fd < 0)
+		return 0;
+	gFound.count = pread(fd, gFound.buf, SNIFF_SIZE, 0);
+	close(fd);
+	if(gFound.count < 0)
+		return 0;
+	UTF8ToMacRoman(path + ftw->base, pName);
+	// Longer host names would be cut short by any Mac copy anyway.
+	if(pName[0] > sizeof(gFound.name) - 1)
+		pName[0] = sizeof(gFound.name) - 1;
+	memcpy(gFound.name, pName, pName[0] + 1);
+	Try(&gFound, "real");
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	long fuzz = 100000, before;
+	int ch, i;
+
+	while((ch = getopt(argc, argv, "n:x:o:")) != -1)
+	{
+		switch(ch)
+		{
+			case 'n':
+				fuzz = atol(optarg);
+				break;
+			case 'x':
+				CorpusSeed(strtoull(optarg, nil, 0));
+				break;
+			case 'o':
+				gOutDir = optarg;
+				break;
+			default:
+				fprintf(stderr, "usage: fix-a-fork-diff [-n fuzz] [-x seed] [-o dir] [path...]\n");
+				return 2;
+		}
+	}
+
+	Generated();
+	before = gInputs;
+	Fuzzed(fuzz);
+	fprintf(stderr, "%ld generated, %ld fuzzed", before, gInputs - before);
+	before = gInputs;
+	for(i = optind; i < argc; i++)
+		if(nftw(argv[i], Visit, 16, FTW_PHYS) != 0)
+			perror(argv[i]);
+	fprintf(stderr, ", %ld real inputs; %d engines, %ld mismatches\n", gInputs - before, kNumEngines, gMismatches);
+	if(gMismatches > kMaxReports)
+		printf("(only the first %d shown)\n", kMaxReports);
+	return gMismatches ? 1 : 0;
+}
@@ -0,0 +1,398 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+
+// export mode: wrap classified host files as MacBinary III or
+// AppleSingle, so the detected type/creator survives FTP and HTTP. Only
+// the header is built in memory; the data fork goes from the source to
+// the output with CopyRange. Files are sniffed and written by a pool of
+// workers, either each into its own file under an output tree, or one
+// after another (in argument order) into a single stream.
+
+#define _GNU_SOURCE
+#include "host.h"
+#include "io.h"
+#include "macroman.h"
+#include "../detect.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define kMacBinaryHeader 128
+#define kMacEpochOffset 2082844800L		// 1904 to 1970
+#define kAppleSingleEpochOffset 946684800L	// 1970 to 2000
+#define kAppleSingleEntries 4
+#define kAppleSingleHeader (26 + 12 * kAppleSingleEntries)
+
+typedef struct {
+	char **paths;
+	long count;
+	long max;
+} PathList;
+
+static PathList gPaths;
+static Boolean gAppleSingle = false;
+static const char *gOutDir = nil;
+static int gStream = 1;
+static long gNext = 0;
+static long gTurn = 0;			// stream mode: whose turn it is to write
+static long gExported = 0;
+static long gUnknown = 0;
+static long gErrors = 0;
+static ResultLog *gLog = nil;
+static pthread_mutex_t gLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gTurnCond = PTHREAD_COND_INITIALIZER;
+
+static int AddPath(const char *path)
+{
+	char **grown;
+
+	if(gPaths.count == gPaths.max)
+	{
+		gPaths.max = gPaths.max ? gPaths.max * 2 : 256;
+		grown = realloc(gPaths.paths, sizeof(char *) * gPaths.max);
+		if(!grown)
+			return -1;
+		gPaths.paths = grown;
+	}
+	gPaths.paths[gPaths.count] = strdup(path);
+	if(!gPaths.paths[gPaths.count])
+		return -1;
+	gPaths.count++;
+	return 0;
+}
+
+static int WalkProc(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+	if(flag == FTW_F && S_ISREG(st->st_mode))
+		return AddPath(path);
+	return 0;
+}
+
+// CRC-16/XMODEM, as MacBinary II and III use for the header.
+static UInt16 Crc16(const Byte *p, long len)
+{
+	UInt16 crc = 0;
+	long i;
+	short k;
+
+	for(i = 0; i < len; i++)
+	{
+		crc ^= p[i] << 8;
+		for(k = 0; k < 8; k++)
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+	}
+	return crc;
+}
+
+static long MacBinaryHeader(Byte *h, const unsigned char *pName, SniffRec *s, struct stat *st)
+{
+	UInt32 date = st->st_mtime + kMacEpochOffset;
+	short len = pName[0] > 63 ? 63 : pName[0];
+
+	memset(h, 0, kMacBinaryHeader);
+	h[1] = len;
+	memcpy(h + 2, pName + 1, len);
+	Put32BE(h + 65, s->type);
+	Put32BE(h + 69, s->creator);
+	Put32BE(h + 83, st->st_size);
+	Put32BE(h + 91, date);
+	Put32BE(h + 95, date);
+	Put32BE(h + 102, 'mBIN');
+	h[122] = 130;	// MacBinary III
+	h[123] = 129;	// readable by MacBinary II
+	Put16BE(h + 124, Crc16(h, 124));
+	return kMacBinaryHeader;
+}
+
+static long AppleSingleHeader(Byte *h, const unsigned char *pName, SniffRec *s, struct stat *st)
+{
+	UInt32 date = st->st_mtime - kAppleSingleEpochOffset;
+	long nameOff = kAppleSingleHeader, datesOff = nameOff + pName[0];
+	long finfoOff = datesOff + 16, dataOff = finfoOff + 32;
+	Byte *e = h + 26;
+
+	memset(h, 0, dataOff);
+	Put32BE(h, 0x00051600);
+	Put32BE(h + 4, 0x00020000);
+	Put16BE(h + 24, kAppleSingleEntries);
+
+	// Entries: real name, dates, FinderInfo, data fork.
+	Put32BE(e, 3);
+	Put32BE(e + 4, nameOff);
+	Put32BE(e + 8, pName[0]);
+	Put32BE(e + 12, 8);
+	Put32BE(e + 16, datesOff);
+	Put32BE(e + 20, 16);
+	Put32BE(e + 24, 9);
+	Put32BE(e + 28, finfoOff);
+	Put32BE(e + 32, 32);
+	Put32BE(e + 36, 1);
+	Put32BE(e + 40, dataOff);
+	Put32BE(e + 44, st->st_size);
+
+	memcpy(h + nameOff, pName + 1, pName[0]);
+	Put32BE(h + datesOff, date);
+	Put32BE(h + datesOff + 4, date);
+	Put32BE(h + datesOff + 8, 0x80000000);	// never backed up
+	Put32BE(h + datesOff + 12, date);
+	Put32BE(h + finfoOff, s->type);
+	Put32BE(h + finfoOff + 4, s->creator);
+	return dataOff;
+}
+
+// The input path made relative and resolved: empty and "." components
+// go, ".." takes back the one before it and is dropped at the top.
+static int CleanPath(const char *path, char *rel, size_t size)
+{
+	const char *p = path, *end;
+	size_t len = 0, n;
+
+	rel[0] = 0;
+	for(; *p; p = end)
+	{
+		while(*p == '/')
+			p++;
+		end = strchr(p, '/');
+		if(!end)
+			end = p + strlen(p);
+		n = end - p;
+		if(n == 0 || (n == 1 && p[0] == '.'))
+			continue;
+		if(n == 2 && p[0] == '.' && p[1] == '.')
+		{
+			while(len && rel[len - 1] != '/')
+				len--;
+			if(len)
+				len--;
+			rel[len] = 0;
+			continue;
+		}
+		if(len + 1 + n >= size)
+			return -1;
+		if(len)
+			rel[len++] = '/';
+		memcpy(rel + len, p, n);
+		len += n;
+		rel[len] = 0;
+	}
+	return len ? 0 : -1;
+}
+
+static int OpenOutput(const char *path)
+{
+	char out[4096], rel[4096];
+
+	// Keep the input's relative layout, but never climb out of gOutDir.
+	if(CleanPath(path, rel, sizeof(rel)))
+		return -1;
+	if(snprintf(out, sizeof(out), "%s/%s%s", gOutDir, rel, gAppleSingle ? ".as" : ".bin") >= (int)sizeof(out))
+		return -1;
+	if(MakeParents(out))
+		return -1;
+	return open(out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+}
+
+static int ExportFile(int in, int out, Byte *h, long hLen, struct stat *st)
+{
+	static const Byte zeros[kMacBinaryHeader];
+	off_t off = 0;
+	long pad = gAppleSingle ? 0 : (kMacBinaryHeader - st->st_size % kMacBinaryHeader) % kMacBinaryHeader;
+
+	if(WriteAll(out, h, hLen) || CopyRange(in, &off, out, st->st_size))
+		return -1;
+	return WriteAll(out, zeros, pad);
+}
+
+static void Report(const char *path, SniffRec *s, Boolean found, int err, struct stat *st, UInt32 micros)
+{
+	char type[5], creator[5];
+	ResultRec rec = {0};
+
+	pthread_mutex_lock(&gLock);
+	if(gLog)
+	{
+		rec.path = path;
+		rec.fileID = err == -43 ? 0 : st->st_ino;
+		rec.newType = found ? s->type : 0;
+		rec.newCreator = found ? s->creator : 0;
+		rec.detector = found ? s->detector : kDetectNone;
+		rec.err = err;
+		rec.micros = micros;
+		ResultLogAppend(gLog, &rec);
+	}
+	if(err)
+	{
+		fprintf(stderr, "%s\terror %d\n", path, err);
+		gErrors++;
+	}
+	else if(!found)
+	{
+		fprintf(stderr, "%s\tunknown\n", path);
+		gUnknown++;
+	}
+	else
+	{
+		FormatOSType(s->type, type);
+		FormatOSType(s->creator, creator);
+		fprintf(stderr, "%s\t%s/%s\t%s\n", path, type, creator, DetectorName(s->detector));
+		gExported++;
+	}
+	pthread_mutex_unlock(&gLock);
+}
+
+static void *ExportWorker(void *arg)
+{
+	SniffRec *s = calloc(1, sizeof(SniffRec));
+	Byte h[kAppleSingleHeader + 255 + 16 + 32];
+	unsigned char pName[256];
+	struct stat st;
+	const char *path, *base;
+	long i, hLen = 0;
+	UInt32 start;
+	Boolean found;
+	int in, out, err;
+
+	if(!s)
+		return nil;
+	for(;;)
+	{
+		pthread_mutex_lock(&gLock);
+		i = gNext++;
+		pthread_mutex_unlock(&gLock);
+		if(i >= gPaths.count)
+			break;
+
+		start = HostMicros();
+		path = gPaths.paths[i];
+		base = strrchr(path, '/');
+		UTF8ToMacRoman(base ? base + 1 : path, pName);
+		found = false;
+		err = 0;
+		in = open(path, O_RDONLY);
+		if(in < 0 || fstat(in, &st))
+			err = -43; // fnfErr
+		else if(st.st_size > 0xFFFFFFFFL)
+			err = -36; // ioErr, too big for either format
+		else
+		{
+			s->count = pread(in, s->buf, SNIFF_SIZE, 0);
+			SniffPad(s);
+			found = SniffFile(s, pName) && s->type != 0 && s->creator != 0;
+			if(found)
+				hLen = gAppleSingle ? AppleSingleHeader(h, pName, s, &st) : MacBinaryHeader(h, pName, s, &st);
+		}
+
+		if(gOutDir)
+		{
+			if(found)
+			{
+				out = OpenOutput(path);
+				if(out < 0 || ExportFile(in, out, h, hLen, &st))
+					err = -36;
+				if(out >= 0 && close(out))
+					err = -36;
+			}
+		}
+		else
+		{
+			// One stream: sniff in parallel, write in order.
+			pthread_mutex_lock(&gLock);
+			while(gTurn != i)
+				pthread_cond_wait(&gTurnCond, &gLock);
+			pthread_mutex_unlock(&gLock);
+			if(found && ExportFile(in, gStream, h, hLen, &st))
+				err = -36;
+			pthread_mutex_lock(&gLock);
+			gTurn++;
+			pthread_cond_broadcast(&gTurnCond);
+			pthread_mutex_unlock(&gLock);
+		}
+		if(in >= 0)
+			close(in);
+		Report(path, s, found, err, &st, HostMicros() - start);
+	}
+	free(s);
+	return nil;
+}
+
+int ExportMain(int argc, char **argv)
+{
+	pthread_t *threads;
+	long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	struct stat st;
+	int ch, i;
+
+	while((ch = getopt(argc, argv, "aj:o:r:")) != -1)
+	{
+		switch(ch)
+		{
+			case 'a':
+				gAppleSingle = true;
+				break;
+			case 'j':
+				jobs = atol(optarg);
+				break;
+			case 'o':
+				gOutDir = optarg;
+				break;
+			case 'r':
+				gLog = OpenResultLog(optarg);
+				if(!gLog)
+					return 1;
+				break;
+			default:
+				fprintf(stderr, "usage: fix-a-fork-host export [-a] [-j jobs] [-o dir] [-r log] path...\n");
+				return 2;
+		}
+	}
+	if(optind == argc)
+	{
+		fprintf(stderr, "usage: fix-a-fork-host export [-a] [-j jobs] [-o dir] [-r log] path...\n");
+		return 2;
+	}
+	if(!gOutDir && isatty(gStream))
+	{
+		fprintf(stderr, "export: not writing a stream to a terminal, use -o or redirect\n");
+		return 2;
+	}
+	for(i = optind; i < argc; i++)
+	{
+		if(stat(argv[i], &st))
+		{
+			perror(argv[i]);
+			gErrors++;
+		}
+		else if(S_ISDIR(st.st_mode))
+		{
+			if(nftw(argv[i], WalkProc, 32, FTW_PHYS))
+				gErrors++;
+		}
+		else if(AddPath(argv[i]))
+			gErrors++;
+	}
+	if(jobs < 1)
+		jobs = 1;
+
+	threads = calloc(jobs, sizeof(pthread_t));
+	for(i = 0; i < jobs; i++)
+		pthread_create(&threads[i], nil, ExportWorker, nil);
+	for(i = 0; i < jobs; i++)
+		pthread_join(threads[i], nil);
+	free(threads);
+
+	for(i = 0; i < gPaths.count; i++)
+		free(gPaths.paths[i]);
+	free(gPaths.paths);
+	if(CloseResultLog(gLog))
+		gErrors++;
+	fprintf(stderr, "%ld files, %ld exported, %ld unknown, %ld errors\n", gExported + gUnknown + gErrors, gExported, gUnknown, gErrors);
+	return gErrors ? 1 : 0;
+}
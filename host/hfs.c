@@ -0,0 +1,803 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+
+#include "hfs.h"
+#include "macroman.h"
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Error codes borrowed from the File Manager so callers can treat image
+// and volume errors the same way.
+#define ioErr -36
+#define noMacDskErr -57
+#define badMDBErr -60
+#define wrPermErr -61
+#define fnfErr -43
+#define memFullErr -108
+
+#define kMDBOffset 1024
+#define kHFSSig 0x4244		// 'BD'
+#define kHFSPlusSig 0x482B	// 'H+'
+#define kHFSXSig 0x4858		// 'HX'
+#define kDC42Header 84
+#define kMaxNodeSize 32768
+
+#define kNodeLeaf 0xFF
+#define kNodeHeader 1
+#define kNodeMap 2
+#define kCatDirRec 1
+#define kCatFileRec 2
+
+#define kExtentsFileID 3
+#define kCatalogFileID 4
+
+#define kHFSVolumeJournaledMask 0x2000
+
+static UInt16 Get16(const Byte *p)
+{
+	return (p[0] << 8) | p[1];
+}
+
+static UInt32 Get32(const Byte *p)
+{
+	return ((UInt32)p[0] << 24) | ((UInt32)p[1] << 16) | ((UInt32)p[2] << 8) | p[3];
+}
+
+static UInt64 Get64(const Byte *p)
+{
+	return ((UInt64)Get32(p) << 32) | Get32(p + 4);
+}
+
+static void Put32(Byte *p, UInt32 v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+// Bounds checked pointer into the image, nil if len bytes at off aren't
+// all there. Every read of image data goes through here.
+static Byte *ImagePtr(HFSVolume *v, size_t off, size_t len)
+{
+	if(off > v->mapSize || len > v->mapSize - off)
+		return nil;
+	return v->map + off;
+}
+
+// HFS extent records are three 16-bit pairs, HFS+ eight 32-bit pairs.
+static short ReadExtRec(HFSVolume *v, const Byte *p, HFSExtent *ext)
+{
+	short i;
+	if(v->plus)
+	{
+		for(i = 0; i < 8; i++)
+		{
+			ext[i].start = Get32(p + i * 8);
+			ext[i].count = Get32(p + i * 8 + 4);
+		}
+		return 8;
+	}
+	for(i = 0; i < 3; i++)
+	{
+		ext[i].start = Get16(p + i * 4);
+		ext[i].count = Get16(p + i * 4 + 2);
+	}
+	return 3;
+}
+
+static void ForkInit(HFSVolume *v, HFSFork *f, UInt32 fileID, Byte forkType, UInt64 logicalSize, const Byte *extRec)
+{
+	f->fileID = fileID;
+	f->forkType = forkType;
+	f->logicalSize = logicalSize;
+	f->ext = f->first;
+	f->numExt = ReadExtRec(v, extRec, f->first);
+	f->maxExt = 8;
+	f->overflowLoaded = false;
+}
+
+static void ForkFree(HFSFork *f)
+{
+	if(f->ext != f->first)
+		free(f->ext);
+	f->ext = f->first;
+	f->numExt = 0;
+	f->maxExt = 8;
+}
+
+static OSErr ForkAppend(HFSFork *f, const HFSExtent *ext)
+{
+	HFSExtent *grown;
+
+	if(f->numExt == f->maxExt)
+	{
+		grown = malloc(sizeof(HFSExtent) * f->maxExt * 2);
+		if(!grown)
+			return memFullErr;
+		memcpy(grown, f->ext, sizeof(HFSExtent) * f->numExt);
+		if(f->ext != f->first)
+			free(f->ext);
+		f->ext = grown;
+		f->maxExt *= 2;
+	}
+	f->ext[f->numExt++] = *ext;
+	return noErr;
+}
+
+static UInt64 ForkBlocks(HFSFork *f)
+{
+	UInt64 blocks = 0;
+	short i;
+	for(i = 0; i < f->numExt; i++)
+		blocks += f->ext[i].count;
+	return blocks;
+}
+
+// Image offset of fork offset off, and how many bytes follow it
+// contiguously. Returns 0 past the end of the fork.
+static UInt64 ForkMap(HFSVolume *v, HFSFork *f, UInt64 off, size_t *imageOff)
+{
+	UInt64 base = 0, len;
+	short i;
+
+	if(off >= f->logicalSize)
+		return 0;
+	for(i = 0; i < f->numExt; i++)
+	{
+		len = (UInt64)f->ext[i].count * v->blockSize;
+		if(off < base + len)
+		{
+			*imageOff = v->blockBase + (UInt64)f->ext[i].start * v->blockSize + (off - base);
+			len = base + len - off;
+			if(len > f->logicalSize - off)
+				len = f->logicalSize - off;
+			return len;
+		}
+		base += len;
+	}
+	return 0;
+}
+
+// Copies len bytes at fork offset off, following extents. Returns the
+// number of bytes copied, short only at the end of the fork.
+static long ForkCopy(HFSVolume *v, HFSFork *f, UInt64 off, Byte *buf, long len)
+{
+	long done = 0;
+	UInt64 run;
+	size_t imageOff;
+	Byte *p;
+
+	while(done < len)
+	{
+		run = ForkMap(v, f, off + done, &imageOff);
+		if(run == 0)
+			break;
+		if(run > (UInt64)(len - done))
+			run = len - done;
+		p = ImagePtr(v, imageOff, run);
+		if(!p)
+			return -1;
+		memcpy(buf + done, p, run);
+		done += run;
+	}
+	return done;
+}
+
+// Pointer to a B-tree node. It points straight into the image unless the
+// node straddles two extents, which HFS+ allows when allocation blocks
+// are smaller than nodes; then it is copied into scratch.
+static Byte *NodePtr(HFSVolume *v, HFSFork *f, UInt16 nodeSize, UInt32 node, Byte *scratch)
+{
+	size_t imageOff;
+	UInt64 off = (UInt64)node * nodeSize;
+
+	if(ForkMap(v, f, off, &imageOff) >= nodeSize)
+		return ImagePtr(v, imageOff, nodeSize);
+	if(scratch && ForkCopy(v, f, off, scratch, nodeSize) == nodeSize)
+		return scratch;
+	return nil;
+}
+
+// Offset of record i within a node, nil if it doesn't leave room for
+// need bytes. numRecs comes from the image, so i can run past the
+// offsets the node has room for.
+static Byte *NodeRecord(Byte *n, UInt16 nodeSize, UInt16 i, UInt16 need)
+{
+	UInt16 off;
+
+	if(2 * ((UInt32)i + 1) > (UInt32)nodeSize - 14)
+		return nil;
+	off = Get16(n + nodeSize - 2 * (i + 1));
+	if(off < 14 || (UInt32)off + need > nodeSize)
+		return nil;
+	return n + off;
+}
+
+// Appends the overflow extents of f from the extents B-tree, if the first
+// extent record doesn't cover the whole fork.
+static OSErr ForkLoadOverflow(HFSVolume *v, HFSFork *f)
+{
+	Byte *hdr, *n, *rec, *local;
+	UInt32 node, fileID, visited = 0, totalNodes;
+	UInt16 nodeSize, numRecs, i;
+	HFSExtent ext[8];
+	short j, count, keyLen;
+	Byte forkType;
+	OSErr err;
+
+	if(f->overflowLoaded)
+		return noErr;
+	f->overflowLoaded = true;
+	if(ForkBlocks(f) * v->blockSize >= f->logicalSize || f->fileID == kExtentsFileID)
+		return noErr;
+
+	hdr = NodePtr(v, &v->extents, 512, 0, nil);
+	if(!hdr)
+		return badMDBErr;
+	nodeSize = Get16(hdr + 14 + 18);
+	node = Get32(hdr + 14 + 10);
+	totalNodes = Get32(hdr + 14 + 22);
+	if(nodeSize < 512 || nodeSize > kMaxNodeSize)
+		return badMDBErr;
+	// Only the odd fragmented fork gets this far.
+	local = malloc(nodeSize);
+	if(!local)
+		return memFullErr;
+
+	err = noErr;
+	while(node != 0 && !err)
+	{
+		if(++visited > totalNodes)
+		{
+			err = badMDBErr;
+			break;
+		}
+		n = NodePtr(v, &v->extents, nodeSize, node, local);
+		if(!n || n[8] != kNodeLeaf)
+		{
+			err = badMDBErr;
+			break;
+		}
+		numRecs = Get16(n + 10);
+		for(i = 0; i < numRecs; i++)
+		{
+			// HFS key: len.b type.b fileID.l start.w, HFS+ key: len.w
+			// type.b pad.b fileID.l start.l, extents follow the key.
+			rec = NodeRecord(n, nodeSize, i, v->plus ? 12 + 64 : 8 + 12);
+			if(!rec)
+			{
+				err = badMDBErr;
+				break;
+			}
+			keyLen = v->plus ? 12 : 8;
+			forkType = v->plus ? rec[2] : rec[1];
+			fileID = Get32(rec + (v->plus ? 4 : 2));
+			// Keys sort by file ID, then fork type, then start block.
+			if(fileID > f->fileID || (fileID == f->fileID && forkType > f->forkType))
+			{
+				node = 0;
+				break;
+			}
+			if(fileID != f->fileID || forkType != f->forkType)
+				continue;
+			count = ReadExtRec(v, rec + keyLen, ext);
+			for(j = 0; j < count && !err; j++)
+				if(ext[j].count)
+					err = ForkAppend(f, &ext[j]);
+		}
+		if(node != 0)
+			node = Get32(n);
+	}
+	free(local);
+	return err;
+}
+
+long HFSReadFork(HFSVolume *v, HFSFork *f, UInt64 offset, void *buf, long len)
+{
+	if(ForkLoadOverflow(v, f))
+		return -1;
+	return ForkCopy(v, f, offset, buf, len);
+}
+
+// Disk Copy 4.2 data checksum: add each big-endian word, rotate right.
+static UInt32 DC42Checksum(const Byte *p, UInt32 len)
+{
+	UInt32 sum = 0, i;
+	for(i = 0; i + 1 < len; i += 2)
+	{
+		sum += Get16(p + i);
+		sum = (sum >> 1) | (sum << 31);
+	}
+	return sum;
+}
+
+static Boolean IsVolumeSig(HFSVolume *v, size_t volOffset)
+{
+	Byte *p = ImagePtr(v, volOffset + kMDBOffset, 2);
+	if(!p)
+		return false;
+	return Get16(p) == kHFSSig || Get16(p) == kHFSPlusSig || Get16(p) == kHFSXSig;
+}
+
+// Finds the volume inside the image: bare, Disk Copy 4.2, or the first
+// Apple_HFS partition of a partitioned disk or CD.
+static OSErr FindVolume(HFSVolume *v)
+{
+	Byte *p, *pm;
+	UInt32 blkSize, mapCount, i;
+
+	if(IsVolumeSig(v, 0))
+	{
+		v->volOffset = 0;
+		return noErr;
+	}
+
+	p = ImagePtr(v, 0, kDC42Header);
+	if(p && Get16(p + 82) == 0x0100 && (UInt64)Get32(p + 64) + Get32(p + 68) + kDC42Header == v->mapSize)
+	{
+		v->volOffset = kDC42Header;
+		v->dc42 = true;
+		v->dc42DataSize = Get32(p + 64);
+		return IsVolumeSig(v, v->volOffset) ? noErr : noMacDskErr;
+	}
+
+	// Driver descriptor map then the partition map, one entry per block.
+	p = ImagePtr(v, 0, 4);
+	if(!p || Get16(p) != 0x4552) // 'ER'
+		return noMacDskErr;
+	blkSize = Get16(p + 2);
+	if(blkSize < 512 || blkSize % 512)
+		blkSize = 512;
+	pm = ImagePtr(v, blkSize, 16);
+	if(!pm || Get16(pm) != 0x504D) // 'PM'
+		return noMacDskErr;
+	mapCount = Get32(pm + 4);
+	for(i = 1; i <= mapCount; i++)
+	{
+		pm = ImagePtr(v, (size_t)i * blkSize, 80);
+		if(!pm || Get16(pm) != 0x504D)
+			break;
+		if(strncmp((char *)pm + 48, "Apple_HFS", 9) == 0)
+		{
+			v->volOffset = (size_t)Get32(pm + 8) * blkSize;
+			return IsVolumeSig(v, v->volOffset) ? noErr : noMacDskErr;
+		}
+	}
+	return noMacDskErr;
+}
+
+static OSErr OpenHFS(HFSVolume *v, Byte *mdb)
+{
+	v->numBlocks = Get16(mdb + 18);
+	v->blockSize = Get32(mdb + 20);
+	v->blockBase = v->volOffset + (size_t)Get16(mdb + 28) * 512;
+	ForkInit(v, &v->extents, kExtentsFileID, 0, Get32(mdb + 130), mdb + 134);
+	ForkInit(v, &v->catalog, kCatalogFileID, 0, Get32(mdb + 146), mdb + 150);
+	return noErr;
+}
+
+static OSErr OpenHFSPlus(HFSVolume *v, Byte *vh)
+{
+	v->plus = true;
+	v->journaled = (Get32(vh + 4) & kHFSVolumeJournaledMask) != 0;
+	v->blockSize = Get32(vh + 40);
+	v->numBlocks = Get32(vh + 44);
+	v->blockBase = v->volOffset;
+	// Fork data: logical size, clump size, total blocks, then extents.
+	ForkInit(v, &v->extents, kExtentsFileID, 0, Get64(vh + 192), vh + 192 + 16);
+	ForkInit(v, &v->catalog, kCatalogFileID, 0, Get64(vh + 272), vh + 272 + 16);
+	return noErr;
+}
+
+// Copies the catalog's node allocation bitmap: the map record of the
+// header node, then any map nodes chained after it.
+static OSErr LoadNodeMap(HFSVolume *v, Byte *hdr, Byte *scratch)
+{
+	Byte *n, *rec, *grown;
+	UInt16 recOff, endOff;
+	UInt32 node, bytes = 0, visited = 0;
+	short mapRec = 2;
+
+	n = hdr;
+	for(;;)
+	{
+		recOff = Get16(n + v->nodeSize - 2 * (mapRec + 1));
+		endOff = Get16(n + v->nodeSize - 2 * (mapRec + 2));
+		if(recOff < 14 || endOff <= recOff || endOff > v->nodeSize)
+			return badMDBErr;
+		rec = n + recOff;
+		grown = realloc(v->nodeMap, bytes + (endOff - recOff));
+		if(!grown)
+			return memFullErr;
+		v->nodeMap = grown;
+		memcpy(v->nodeMap + bytes, rec, endOff - recOff);
+		bytes += endOff - recOff;
+
+		node = Get32(n);
+		if(node == 0 || bytes * 8 >= v->totalNodes || ++visited > v->totalNodes)
+			break;
+		n = NodePtr(v, &v->catalog, v->nodeSize, node, scratch);
+		if(!n || n[8] != kNodeMap)
+			return badMDBErr;
+		mapRec = 0;
+	}
+	v->nodeMapBits = bytes * 8;
+	return noErr;
+}
+
+OSErr HFSOpen(HFSVolume *v, const char *path, Boolean writable)
+{
+	struct stat st;
+	Byte *mdb, *hdr, *scratch;
+	OSErr err;
+
+	memset(v, 0, sizeof(*v));
+	v->path = path;
+	v->writable = writable;
+	v->fd = open(path, writable ? O_RDWR : O_RDONLY);
+	if(v->fd < 0)
+		return writable ? wrPermErr : fnfErr;
+	if(fstat(v->fd, &st) || st.st_size < kMDBOffset + 512)
+	{
+		close(v->fd);
+		return noMacDskErr;
+	}
+	v->mapSize = st.st_size;
+	v->map = mmap(nil, v->mapSize, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, v->fd, 0);
+	if(v->map == MAP_FAILED)
+	{
+		close(v->fd);
+		return ioErr;
+	}
+
+	err = FindVolume(v);
+	if(err)
+		goto fail;
+	mdb = ImagePtr(v, v->volOffset + kMDBOffset, 512);
+	if(!mdb)
+	{
+		err = badMDBErr;
+		goto fail;
+	}
+	if(Get16(mdb) == kHFSSig && Get16(mdb + 124) == kHFSPlusSig)
+	{
+		// HFS wrapper: the HFS+ volume sits in the embedded extent.
+		v->volOffset += (size_t)Get16(mdb + 28) * 512 + (size_t)Get16(mdb + 126) * Get32(mdb + 20);
+		mdb = ImagePtr(v, v->volOffset + kMDBOffset, 512);
+		if(!mdb || (Get16(mdb) != kHFSPlusSig && Get16(mdb) != kHFSXSig))
+		{
+			err = badMDBErr;
+			goto fail;
+		}
+	}
+	err = (Get16(mdb) == kHFSSig) ? OpenHFS(v, mdb) : OpenHFSPlus(v, mdb);
+	if(err)
+		goto fail;
+	if(v->blockSize < 512 || v->blockSize % 512)
+	{
+		err = badMDBErr;
+		goto fail;
+	}
+	// Patching behind the back of a journal isn't safe.
+	if(v->journaled && writable)
+	{
+		err = wrPermErr;
+		goto fail;
+	}
+
+	err = ForkLoadOverflow(v, &v->catalog);
+	if(err)
+		goto fail;
+	hdr = NodePtr(v, &v->catalog, 512, 0, nil);
+	if(!hdr || hdr[8] != kNodeHeader)
+	{
+		err = badMDBErr;
+		goto fail;
+	}
+	v->nodeSize = Get16(hdr + 14 + 18);
+	v->totalNodes = Get32(hdr + 14 + 22);
+	if(v->nodeSize < 512 || v->nodeSize > kMaxNodeSize || v->nodeSize % 512)
+	{
+		err = badMDBErr;
+		goto fail;
+	}
+	scratch = malloc(v->nodeSize);
+	hdr = scratch ? NodePtr(v, &v->catalog, v->nodeSize, 0, scratch) : nil;
+	err = hdr ? LoadNodeMap(v, hdr, scratch) : badMDBErr;
+	free(scratch);
+	if(err)
+		goto fail;
+	return noErr;
+
+fail:
+	HFSClose(v);
+	return err;
+}
+
+void HFSClose(HFSVolume *v)
+{
+	Byte *p;
+
+	if(v->map && v->map != MAP_FAILED)
+	{
+		if(v->dirty && v->dc42)
+		{
+			p = ImagePtr(v, kDC42Header, v->dc42DataSize);
+			if(p)
+				Put32(v->map + 72, DC42Checksum(p, v->dc42DataSize));
+		}
+		if(v->dirty)
+			msync(v->map, v->mapSize, MS_SYNC);
+		munmap(v->map, v->mapSize);
+	}
+	if(v->fd >= 0)
+		close(v->fd);
+	ForkFree(&v->catalog);
+	ForkFree(&v->extents);
+	free(v->nodeMap);
+	v->nodeMap = nil;
+	v->map = nil;
+	v->fd = -1;
+}
+
+static OSErr AddDir(HFSDirList *l, UInt32 dirID, UInt32 parID, const char *name)
+{
+	size_t len = strlen(name) + 1;
+	void *grown;
+
+	if(l->numDirs == l->maxDirs)
+	{
+		l->maxDirs = l->maxDirs ? l->maxDirs * 2 : 64;
+		grown = realloc(l->dirs, sizeof(HFSCatDir) * l->maxDirs);
+		if(!grown)
+			return memFullErr;
+		l->dirs = grown;
+	}
+	while(l->namesLen + len > l->namesMax)
+	{
+		l->namesMax = l->namesMax ? l->namesMax * 2 : 4096;
+		grown = realloc(l->names, l->namesMax);
+		if(!grown)
+			return memFullErr;
+		l->names = grown;
+	}
+	l->dirs[l->numDirs].dirID = dirID;
+	l->dirs[l->numDirs].parID = parID;
+	l->dirs[l->numDirs].nameOff = l->namesLen;
+	l->numDirs++;
+	memcpy(l->names + l->namesLen, name, len);
+	l->namesLen += len;
+	return noErr;
+}
+
+// One leaf record. Fills f and returns kCatFileRec for files, records
+// directories in dirs, and ignores thread records.
+static short ParseRecord(HFSVolume *v, Byte *n, UInt32 node, UInt16 i, HFSCatFile *f, HFSDirList *dirs, OSErr *err)
+{
+	Byte *rec, *data, *end = n + v->nodeSize;
+	char uname[768];
+	UInt32 parID;
+	short type;
+
+	rec = NodeRecord(n, v->nodeSize, i, 8);
+	if(!rec)
+	{
+		*err = badMDBErr;
+		return 0;
+	}
+	if(v->plus)
+	{
+		// Key: len.w parID.l then an HFSUniStr255.
+		UInt16 nameLen = Get16(rec + 6);
+		if(nameLen > 255 || rec + 8 + nameLen * 2 > end)
+			return 0;
+		data = rec + 2 + Get16(rec);
+		if(data + 2 > end)
+			return 0;
+		parID = Get32(rec + 2);
+		type = Get16(data);
+		UTF16BEToUTF8(rec + 8, nameLen, uname, sizeof(uname));
+		if(type == kCatDirRec && data + 88 <= end)
+		{
+			if(dirs)
+				*err = AddDir(dirs, Get32(data + 8), parID, uname);
+			return kCatDirRec;
+		}
+		if(type != kCatFileRec || data + 248 > end)
+			return 0;
+		memset(f, 0, sizeof(*f));
+		strcpy(f->uname, uname);
+		UTF8ToMacRoman(uname, f->name);
+		f->locked = (Get16(data + 2) & 0x0001) != 0;
+		f->fileID = Get32(data + 8);
+		f->type = Get32(data + 48);
+		f->creator = Get32(data + 52);
+		f->fdFlags = Get16(data + 56);
+		f->rsrcSize = Get64(data + 168);
+		f->finfoOffset = (size_t)node * v->nodeSize + (data - n) + 48;
+		ForkInit(v, &f->data, f->fileID, 0, Get64(data + 88), data + 88 + 16);
+	}
+	else
+	{
+		// Key: len.b resv.b parID.l then a Str31.
+		if(rec[6] > 31 || rec + 7 + rec[6] > end)
+			return 0;
+		// Record data follows the key, padded to a word boundary.
+		data = rec + ((rec[0] + 2) & ~1);
+		if(data + 1 > end)
+			return 0;
+		parID = Get32(rec + 2);
+		type = data[0];
+		if(type == kCatDirRec && data + 70 <= end)
+		{
+			MacRomanToUTF8(rec + 6, uname, sizeof(uname));
+			if(dirs)
+				*err = AddDir(dirs, Get32(data + 6), parID, uname);
+			return kCatDirRec;
+		}
+		if(type != kCatFileRec || data + 102 > end)
+			return 0;
+		memset(f, 0, sizeof(*f));
+		memcpy(f->name, rec + 6, rec[6] + 1);
+		MacRomanToUTF8(f->name, f->uname, sizeof(f->uname));
+		f->locked = (data[2] & 0x01) != 0;
+		f->type = Get32(data + 4);
+		f->creator = Get32(data + 8);
+		f->fdFlags = Get16(data + 12);
+		f->fileID = Get32(data + 20);
+		f->rsrcSize = Get32(data + 36);
+		f->finfoOffset = (size_t)node * v->nodeSize + (data - n) + 4;
+		ForkInit(v, &f->data, f->fileID, 0, Get32(data + 26), data + 74);
+	}
+	f->parID = parID;
+	f->node = node;
+	f->record = i;
+	return kCatFileRec;
+}
+
+OSErr HFSScanNodes(HFSVolume *v, UInt32 firstNode, UInt32 endNode, HFSFileProc proc, void *refCon, HFSDirList *dirs)
+{
+	Byte *scratch, *n;
+	UInt32 node;
+	UInt16 numRecs, i;
+	HFSCatFile f;
+	OSErr err = noErr;
+	Boolean stop = false;
+
+	if(endNode > v->totalNodes)
+		endNode = v->totalNodes;
+	if(endNode > v->nodeMapBits)
+		endNode = v->nodeMapBits;
+	scratch = malloc(v->nodeSize);
+	if(!scratch)
+		return memFullErr;
+
+	for(node = firstNode; node < endNode && !err && !stop; node++)
+	{
+		// Free nodes can still hold stale leaves, trust only the map.
+		if(!(v->nodeMap[node >> 3] & (0x80 >> (node & 7))))
+			continue;
+		n = NodePtr(v, &v->catalog, v->nodeSize, node, scratch);
+		if(!n)
+		{
+			err = badMDBErr;
+			break;
+		}
+		if(n[8] != kNodeLeaf)
+			continue;
+		numRecs = Get16(n + 10);
+		for(i = 0; i < numRecs && !err && !stop; i++)
+		{
+			if(ParseRecord(v, n, node, i, &f, dirs, &err) != kCatFileRec)
+				continue;
+			stop = proc(v, &f, refCon) != 0;
+			ForkFree(&f.data);
+		}
+	}
+	free(scratch);
+	return err;
+}
+
+OSErr HFSSetFInfo(HFSVolume *v, HFSCatFile *f, OSType type, OSType creator)
+{
+	Byte finfo[8];
+	size_t imageOff;
+	UInt64 run;
+	short done = 0;
+	Byte *p;
+
+	if(!v->writable)
+		return wrPermErr;
+	Put32(finfo, type);
+	Put32(finfo + 4, creator);
+	while(done < 8)
+	{
+		run = ForkMap(v, &v->catalog, f->finfoOffset + done, &imageOff);
+		if(run == 0)
+			return ioErr;
+		if(run > (UInt64)(8 - done))
+			run = 8 - done;
+		p = ImagePtr(v, imageOff, run);
+		if(!p)
+			return ioErr;
+		memcpy(p, finfo + done, run);
+		done += run;
+	}
+	f->type = type;
+	f->creator = creator;
+	v->dirty = true;
+	return noErr;
+}
+
+OSErr HFSDirListMerge(HFSDirList *into, HFSDirList *from)
+{
+	long i;
+	OSErr err;
+
+	for(i = 0; i < from->numDirs; i++)
+	{
+		err = AddDir(into, from->dirs[i].dirID, from->dirs[i].parID, from->names + from->dirs[i].nameOff);
+		if(err)
+			return err;
+	}
+	return noErr;
+}
+
+static int CompareDirs(const void *a, const void *b)
+{
+	UInt32 l = ((const HFSCatDir *)a)->dirID;
+	UInt32 r = ((const HFSCatDir *)b)->dirID;
+	return (l > r) - (l < r);
+}
+
+void HFSDirListSort(HFSDirList *l)
+{
+	if(l->numDirs)
+		qsort(l->dirs, l->numDirs, sizeof(HFSCatDir), CompareDirs);
+}
+
+void HFSDirListFree(HFSDirList *l)
+{
+	free(l->dirs);
+	free(l->names);
+	memset(l, 0, sizeof(*l));
+}
+
+void HFSPath(HFSDirList *l, UInt32 parID, const char *name, char *path, size_t size)
+{
+	const char *parts[64];
+	short depth = 0, i;
+	size_t len = 0, partLen;
+	HFSCatDir key, *d;
+
+	parts[depth++] = name;
+	// The root directory's own record carries the volume name.
+	while(parID != kHFSRootParID && depth < 64)
+	{
+		key.dirID = parID;
+		d = l->numDirs ? bsearch(&key, l->dirs, l->numDirs, sizeof(HFSCatDir), CompareDirs) : nil;
+		if(!d)
+			break;
+		parts[depth++] = l->names + d->nameOff;
+		parID = d->parID;
+	}
+
+	for(i = depth - 1; i >= 0; i--)
+	{
+		partLen = strlen(parts[i]);
+		if(len + partLen + 2 > size)
+			break;
+		memcpy(path + len, parts[i], partLen);
+		len += partLen;
+		if(i > 0)
+			path[len++] = ':';
+	}
+	path[len] = 0;
+}
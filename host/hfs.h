@@ -0,0 +1,111 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+#ifndef __HFS_H__
+#define __HFS_H__
+
+// Read/patch access to HFS and HFS+ volumes inside disk image files,
+// without mounting them. Images are memory mapped, so nothing is copied
+// except the bytes a caller asks for.
+
+#include <MacTypes.h>
+#include <stddef.h>
+
+#define kHFSRootParID 1
+#define kHFSRootDirID 2
+
+typedef struct {
+	UInt32 start;	// allocation block
+	UInt32 count;
+} HFSExtent;
+
+typedef struct {
+	UInt32 fileID;
+	Byte forkType;	// 0x00 data, 0xFF resource
+	UInt64 logicalSize;
+	HFSExtent *ext;
+	short numExt;
+	short maxExt;
+	Boolean overflowLoaded;
+	HFSExtent first[8];
+} HFSFork;
+
+typedef struct {
+	const char *path;
+	Byte *map;
+	size_t mapSize;
+	int fd;
+	Boolean writable;
+	Boolean dirty;
+
+	size_t volOffset;	// start of the volume within the image
+	Boolean dc42;		// Disk Copy 4.2 wrapper, checksum must follow patches
+	UInt32 dc42DataSize;
+	Boolean plus;		// HFS+ (or HFSX), possibly found inside an HFS wrapper
+	Boolean journaled;
+
+	UInt32 blockSize;
+	UInt32 numBlocks;
+	size_t blockBase;	// image offset of allocation block 0
+
+	HFSFork catalog;
+	HFSFork extents;
+	UInt16 nodeSize;
+	UInt32 totalNodes;
+	Byte *nodeMap;		// B-tree allocation bitmap of the catalog
+	UInt32 nodeMapBits;
+} HFSVolume;
+
+// A file record as found in a catalog leaf node.
+typedef struct {
+	UInt32 fileID;
+	UInt32 parID;
+	Str255 name;		// Mac Roman, what the detectors see
+	char uname[768];	// UTF-8, for reporting
+	OSType type;
+	OSType creator;
+	UInt16 fdFlags;
+	Boolean locked;
+	HFSFork data;
+	UInt64 rsrcSize;
+	UInt32 node;		// where the record lives, for stable ordering
+	UInt16 record;
+	size_t finfoOffset;	// catalog fork offset of fdType
+} HFSCatFile;
+
+// Directory records seen during a scan, used to build paths. Names are
+// UTF-8 and live in one shared buffer.
+typedef struct {
+	UInt32 dirID;
+	UInt32 parID;
+	size_t nameOff;
+} HFSCatDir;
+
+typedef struct {
+	HFSCatDir *dirs;
+	long numDirs;
+	long maxDirs;
+	char *names;
+	size_t namesLen;
+	size_t namesMax;
+} HFSDirList;
+
+typedef int (*HFSFileProc)(HFSVolume *v, HFSCatFile *f, void *refCon);
+
+OSErr HFSOpen(HFSVolume *v, const char *path, Boolean writable);
+void HFSClose(HFSVolume *v);
+// Visits every file record in the in-use leaf nodes numbered
+// [firstNode, endNode). Leaves are self contained, so disjoint ranges can
+// be scanned from different threads. Stops early if proc returns non-zero.
+OSErr HFSScanNodes(HFSVolume *v, UInt32 firstNode, UInt32 endNode, HFSFileProc proc, void *refCon, HFSDirList *dirs);
+long HFSReadFork(HFSVolume *v, HFSFork *f, UInt64 offset, void *buf, long len);
+OSErr HFSSetFInfo(HFSVolume *v, HFSCatFile *f, OSType type, OSType creator);
+
+OSErr HFSDirListMerge(HFSDirList *into, HFSDirList *from);
+void HFSDirListSort(HFSDirList *l);
+void HFSDirListFree(HFSDirList *l);
+// Colon separated UTF-8 path of a file, starting with the volume name.
+// The list must be sorted.
+void HFSPath(HFSDirList *l, UInt32 parID, const char *name, char *path, size_t size);
+
+#endif
@@ -0,0 +1,31 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+#ifndef __HOST_H__
+#define __HOST_H__
+
+// Host side (Linux) entry points. Each mode parses its own arguments and
+// returns the process exit status.
+
+#include <MacTypes.h>
+#include "../results.h"
+
+int ImageMain(int argc, char **argv);
+int ArchiveMain(int argc, char **argv);
+int ExportMain(int argc, char **argv);
+int WatchMain(int argc, char **argv);
+int PipeMain(int argc, char **argv);
+
+// Four printable characters for an OSType, '.' for anything else.
+void FormatOSType(OSType t, char *out);
+// Monotonic clock for ResultRec.micros.
+UInt32 HostMicros(void);
+// ResultWriteProc for a file descriptor passed as refCon.
+OSErr WriteFdProc(void *refCon, const void *buf, long len);
+// The -r option of every mode. The format follows the extension (see
+// ResultFormatForName); "-" is JSON Lines on stdout. Appends are not
+// locked, callers with threads serialize them.
+ResultLog *OpenResultLog(const char *path);
+OSErr CloseResultLog(ResultLog *log);
+
+#endif
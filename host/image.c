@@ -0,0 +1,412 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+
+// image mode: classify every file inside HFS/HFS+ disk images and patch
+// the FinderInfo in the catalog in place, the same verdict openFile would
+// give if the file had been dropped on the app. Workers share a queue of
+// catalog leaf chunks, so one big image or many small ones both keep
+// every thread busy.
+
+#include "host.h"
+#include "hfs.h"
+#include "../detect.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define kNodesPerChunk 64
+
+typedef struct {
+	UInt32 fileID;
+	UInt32 parID;
+	char *name;
+	OSType oldType;
+	OSType oldCreator;
+	OSType newType;
+	OSType newCreator;
+	short detector;
+	OSErr err;
+	Boolean unchanged;	// only kept when there is a results log
+	UInt32 micros;
+	UInt32 node;
+	UInt16 record;
+} ImageResult;
+
+typedef struct {
+	ImageResult *results;
+	long numResults;
+	long maxResults;
+	HFSDirList dirs;
+	long files;
+} ImageResults;
+
+// An image being worked on. Its catalog is handed out to workers in
+// chunks of leaf nodes; whoever finishes the last chunk reports it.
+typedef struct ImageState {
+	const char *path;
+	HFSVolume vol;
+	UInt32 nextNode;
+	int active;
+	OSErr err;
+	ImageResults all;
+	struct ImageState *next;
+} ImageState;
+
+typedef struct {
+	SniffRec sniff;
+	ImageResults chunk;
+} ImageJob;
+
+static Boolean gDryRun = false;
+static char **gImages;
+static int gNumImages;
+static int gNextImage = 0;
+static ImageState *gOpenImages = nil;
+static int gFailed = 0;
+static ResultLog *gLog = nil;
+static pthread_mutex_t gLock = PTHREAD_MUTEX_INITIALIZER;
+
+static ImageResult *AddResult(ImageResults *list, HFSCatFile *f)
+{
+	ImageResult *r, *grown;
+
+	if(list->numResults == list->maxResults)
+	{
+		list->maxResults = list->maxResults ? list->maxResults * 2 : 64;
+		grown = realloc(list->results, sizeof(ImageResult) * list->maxResults);
+		if(!grown)
+			return nil;
+		list->results = grown;
+	}
+	r = &list->results[list->numResults];
+	memset(r, 0, sizeof(*r));
+	r->name = strdup(f->uname);
+	if(!r->name)
+		return nil;
+	list->numResults++;
+	r->fileID = f->fileID;
+	r->parID = f->parID;
+	r->oldType = f->type;
+	r->oldCreator = f->creator;
+	r->detector = kDetectNone;
+	r->node = f->node;
+	r->record = f->record;
+	return r;
+}
+
+static void FreeResults(ImageResults *list)
+{
+	long i;
+	for(i = 0; i < list->numResults; i++)
+		free(list->results[i].name);
+	free(list->results);
+	HFSDirListFree(&list->dirs);
+	memset(list, 0, sizeof(*list));
+}
+
+// Moves everything in from onto the end of into, leaving from empty but
+// with its buffers, ready for the next chunk.
+static OSErr MergeResults(ImageResults *into, ImageResults *from)
+{
+	ImageResult *grown;
+	long need = into->numResults + from->numResults;
+	OSErr err;
+
+	if(need > into->maxResults)
+	{
+		grown = realloc(into->results, sizeof(ImageResult) * need);
+		if(!grown)
+			return -108; // memFullErr
+		into->results = grown;
+		into->maxResults = need;
+	}
+	memcpy(into->results + into->numResults, from->results, sizeof(ImageResult) * from->numResults);
+	into->numResults = need;
+	into->files += from->files;
+	err = HFSDirListMerge(&into->dirs, &from->dirs);
+
+	from->numResults = 0;
+	from->files = 0;
+	from->dirs.numDirs = 0;
+	from->dirs.namesLen = 0;
+	return err;
+}
+
+static int FixFileProc(HFSVolume *v, HFSCatFile *f, void *refCon)
+{
+	ImageJob *job = refCon;
+	SniffRec *s = &job->sniff;
+	ImageResult *r;
+	UInt32 start = HostMicros();
+	Boolean found, unchanged;
+
+	job->chunk.files++;
+	s->count = HFSReadFork(v, &f->data, 0, s->buf, SNIFF_SIZE);
+	if(s->count < 0)
+	{
+		r = AddResult(&job->chunk, f);
+		if(r)
+			r->err = -36; // ioErr
+		return 0;
+	}
+	SniffPad(s);
+	found = SniffFile(s, f->name);
+
+	// Same rules as openFile: a verdict with a zero type or creator means
+	// "known, but leave it alone".
+	unchanged = found && (s->type == 0 || s->creator == 0 || (s->type == f->type && s->creator == f->creator));
+	if(unchanged && !gLog)
+		return 0;
+
+	r = AddResult(&job->chunk, f);
+	if(!r)
+		return 1;
+	r->detector = s->detector;
+	r->newType = f->type;
+	r->newCreator = f->creator;
+	if(found && !unchanged)
+	{
+		r->newType = s->type;
+		r->newCreator = s->creator;
+		if(!gDryRun)
+			r->err = HFSSetFInfo(v, f, s->type, s->creator);
+	}
+	r->unchanged = unchanged;
+	r->micros = HostMicros() - start;
+	return 0;
+}
+
+static int CompareResults(const void *a, const void *b)
+{
+	const ImageResult *l = a, *r = b;
+	if(l->node != r->node)
+		return (l->node > r->node) - (l->node < r->node);
+	return (l->record > r->record) - (l->record < r->record);
+}
+
+static void PrintResults(ImageState *img)
+{
+	char path[2048], oldT[5], oldC[5], newT[5], newC[5];
+	ImageResults *all = &img->all;
+	ImageResult *r;
+	ResultRec rec;
+	long i, changed = 0, unknown = 0, errors = 0;
+
+	// Chunks finish in any order; report in catalog order.
+	qsort(all->results, all->numResults, sizeof(ImageResult), CompareResults);
+	HFSDirListSort(&all->dirs);
+
+	pthread_mutex_lock(&gLock);
+	for(i = 0; i < all->numResults; i++)
+	{
+		r = &all->results[i];
+		HFSPath(&all->dirs, r->parID, r->name, path, sizeof(path));
+		if(gLog)
+		{
+			rec.path = path;
+			rec.fileID = r->fileID;
+			rec.parID = r->parID;
+			rec.oldType = r->oldType;
+			rec.oldCreator = r->oldCreator;
+			rec.newType = r->newType;
+			rec.newCreator = r->newCreator;
+			rec.detector = r->detector;
+			rec.err = r->err;
+			rec.micros = r->micros;
+			ResultLogAppend(gLog, &rec);
+		}
+		if(r->unchanged)
+			continue;
+		FormatOSType(r->oldType, oldT);
+		FormatOSType(r->oldCreator, oldC);
+		if(r->err)
+		{
+			printf("%s: %s\terror %d\n", img->path, path, r->err);
+			errors++;
+		}
+		else if(r->detector == kDetectNone)
+		{
+			printf("%s: %s\t%s/%s\tunknown\n", img->path, path, oldT, oldC);
+			unknown++;
+		}
+		else
+		{
+			FormatOSType(r->newType, newT);
+			FormatOSType(r->newCreator, newC);
+			printf("%s: %s\t%s/%s -> %s/%s\t%s\n", img->path, path, oldT, oldC, newT, newC, DetectorName(r->detector));
+			changed++;
+		}
+	}
+	if(img->err)
+	{
+		fprintf(stderr, "%s: catalog damaged, error %d\n", img->path, img->err);
+		gFailed = 1;
+	}
+	fprintf(stderr, "%s: %ld files, %ld %s, %ld unknown, %ld errors\n", img->path, all->files,
+		changed, gDryRun ? "would change" : "changed", unknown, errors);
+	if(errors)
+		gFailed = 1;
+	fflush(stdout);
+	pthread_mutex_unlock(&gLock);
+}
+
+// Called with gLock held. Opens the next image and puts it on the list
+// of images with chunks to hand out, or returns false when there are no
+// images left.
+static Boolean OpenNextImage()
+{
+	ImageState *img;
+	OSErr err;
+	int i;
+
+	if(gNextImage >= gNumImages)
+		return false;
+	i = gNextImage++;
+	pthread_mutex_unlock(&gLock);
+
+	img = calloc(1, sizeof(ImageState));
+	err = img ? HFSOpen(&img->vol, gImages[i], !gDryRun) : -108;
+
+	pthread_mutex_lock(&gLock);
+	if(err)
+	{
+		fprintf(stderr, "%s: can't %s volume, error %d\n", gImages[i],
+			err == -61 ? "write to this" : "read an HFS/HFS+", err);
+		gFailed = 1;
+		free(img);
+		return true;
+	}
+	img->path = gImages[i];
+	img->next = gOpenImages;
+	gOpenImages = img;
+	return true;
+}
+
+static void *ImageWorker(void *arg)
+{
+	ImageJob *job = calloc(1, sizeof(ImageJob));
+	ImageState *img, **prev;
+	UInt32 first, end;
+	OSErr err;
+	Boolean done;
+
+	if(!job)
+		return nil;
+	pthread_mutex_lock(&gLock);
+	for(;;)
+	{
+		img = gOpenImages;
+		if(!img)
+		{
+			if(!OpenNextImage())
+				break;
+			continue;
+		}
+		first = img->nextNode;
+		end = first + kNodesPerChunk;
+		img->nextNode = end;
+		img->active++;
+		if(end >= img->vol.totalNodes)
+		{
+			// Last chunk handed out; take it off the list.
+			for(prev = &gOpenImages; *prev != img; prev = &(*prev)->next);
+			*prev = img->next;
+		}
+		pthread_mutex_unlock(&gLock);
+
+		err = HFSScanNodes(&img->vol, first, end, FixFileProc, job, &job->chunk.dirs);
+
+		pthread_mutex_lock(&gLock);
+		if(err && !img->err)
+			img->err = err;
+		err = MergeResults(&img->all, &job->chunk);
+		if(err && !img->err)
+			img->err = err;
+		img->active--;
+		done = img->nextNode >= img->vol.totalNodes && img->active == 0;
+		if(done)
+		{
+			pthread_mutex_unlock(&gLock);
+			PrintResults(img);
+			HFSClose(&img->vol);
+			FreeResults(&img->all);
+			free(img);
+			pthread_mutex_lock(&gLock);
+		}
+	}
+	pthread_mutex_unlock(&gLock);
+	FreeResults(&job->chunk);
+	free(job);
+	return nil;
+}
+
+int ImageMain(int argc, char **argv)
+{
+	pthread_t *threads;
+	long jobs = sysconf(_SC_NPROCESSORS_ONLN), started;
+	int ch, i, err;
+
+	while((ch = getopt(argc, argv, "nj:r:")) != -1)
+	{
+		switch(ch)
+		{
+			case 'n':
+				gDryRun = true;
+				break;
+			case 'j':
+				jobs = atol(optarg);
+				break;
+			case 'r':
+				gLog = OpenResultLog(optarg);
+				if(!gLog)
+					return 1;
+				break;
+			default:
+				fprintf(stderr, "usage: fix-a-fork-host image [-n] [-j jobs] [-r log] image...\n");
+				return 2;
+		}
+	}
+	gImages = argv + optind;
+	gNumImages = argc - optind;
+	if(gNumImages == 0)
+	{
+		fprintf(stderr, "usage: fix-a-fork-host image [-n] [-j jobs] [-r log] image...\n");
+		return 2;
+	}
+	if(jobs < 1)
+		jobs = 1;
+
+	threads = calloc(jobs, sizeof(pthread_t));
+	if(!threads)
+	{
+		fprintf(stderr, "image: can't allocate %ld workers\n", jobs);
+		return 1;
+	}
+	// The workers share the images, so fewer than asked for still get
+	// through them all.
+	for(started = 0; started < jobs; started++)
+	{
+		err = pthread_create(&threads[started], nil, ImageWorker, nil);
+		if(err)
+		{
+			fprintf(stderr, "image: can't start worker %ld: %s\n", started + 1, strerror(err));
+			break;
+		}
+	}
+	if(!started)
+	{
+		free(threads);
+		CloseResultLog(gLog);
+		return 1;
+	}
+	for(i = 0; i < started; i++)
+		pthread_join(threads[i], nil);
+	free(threads);
+	if(CloseResultLog(gLog))
+		gFailed = 1;
+	return gFailed;
+}
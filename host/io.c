@@ -0,0 +1,162 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+
+#define _GNU_SOURCE
+#include "io.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+
+ssize_t ReadFull(int fd, void *buf, size_t len)
+{
+	size_t done = 0;
+	ssize_t n;
+
+	while(done < len)
+	{
+		n = read(fd, (char *)buf + done, len - done);
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n < 0)
+			return -1;
+		if(n == 0)
+			break;
+		done += n;
+	}
+	return done;
+}
+
+int WriteAll(int fd, const void *buf, size_t len)
+{
+	size_t done = 0;
+	ssize_t n;
+
+	while(done < len)
+	{
+		n = write(fd, (const char *)buf + done, len - done);
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n <= 0)
+			return -1;
+		done += n;
+	}
+	return 0;
+}
+
+static int CopyBuffered(int in, off_t *inOff, int out, off_t len)
+{
+	char buf[65536];
+	ssize_t n;
+	size_t want;
+
+	while(len > 0)
+	{
+		want = len < (off_t)sizeof(buf) ? (size_t)len : sizeof(buf);
+		n = inOff ? pread(in, buf, want, *inOff) : read(in, buf, want);
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n <= 0)
+			return -1;
+		if(WriteAll(out, buf, n))
+			return -1;
+		if(inOff)
+			*inOff += n;
+		len -= n;
+	}
+	return 0;
+}
+
+int CopyRange(int in, off_t *inOff, int out, off_t len)
+{
+	ssize_t n;
+	Boolean triedSplice = false;
+
+	while(len > 0)
+	{
+		n = copy_file_range(in, inOff, out, nil, len, 0);
+		if(n > 0)
+		{
+			len -= n;
+			continue;
+		}
+		if(n == 0)
+			return -1;
+		if(errno == EINTR)
+			continue;
+		if(errno != EINVAL && errno != EXDEV && errno != ENOSYS && errno != EBADF && errno != EOPNOTSUPP)
+			return -1;
+		break;
+	}
+
+	// Pipes: splice needs one end to be a pipe, which is exactly the
+	// case copy_file_range refuses.
+	while(len > 0 && !triedSplice)
+	{
+		n = splice(in, inOff, out, nil, len, SPLICE_F_MORE);
+		if(n > 0)
+		{
+			len -= n;
+			continue;
+		}
+		if(n == 0)
+			return -1;
+		if(errno == EINTR)
+			continue;
+		if(errno != EINVAL && errno != ENOSYS && errno != EBADF)
+			return -1;
+		triedSplice = true;
+	}
+
+	return len > 0 ? CopyBuffered(in, inOff, out, len) : 0;
+}
+
+void Put16BE(Byte *p, UInt16 v)
+{
+	p[0] = v >> 8;
+	p[1] = v;
+}
+
+void Put32BE(Byte *p, UInt32 v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+int StampFinderInfo(const char *path, OSType type, OSType creator)
+{
+	Byte finfo[32], was[8];
+	ssize_t n = getxattr(path, "user.com.apple.FinderInfo", finfo, sizeof(finfo));
+
+	if(n != sizeof(finfo))
+		memset(finfo, 0, sizeof(finfo));
+	memcpy(was, finfo, 8);
+	Put32BE(finfo, type);
+	Put32BE(finfo + 4, creator);
+	if(n == sizeof(finfo) && memcmp(was, finfo, 8) == 0)
+		return 0;
+	return setxattr(path, "user.com.apple.FinderInfo", finfo, sizeof(finfo), 0);
+}
+
+int MakeParents(char *path)
+{
+	char *p;
+
+	for(p = strchr(path + 1, '/'); p; p = strchr(p + 1, '/'))
+	{
+		*p = 0;
+		if(mkdir(path, 0755) && errno != EEXIST)
+		{
+			*p = '/';
+			return -1;
+		}
+		*p = '/';
+	}
+	return 0;
+}
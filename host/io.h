@@ -0,0 +1,35 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+#ifndef __IO_H__
+#define __IO_H__
+
+// File helpers shared by the host modes.
+
+#include <MacTypes.h>
+#include <sys/types.h>
+
+// Like read/write, but only short at end of file; -1 on error.
+ssize_t ReadFull(int fd, void *buf, size_t len);
+int WriteAll(int fd, const void *buf, size_t len);
+// Moves len bytes from in to out without passing them through user
+// space when the kernel can: copy_file_range between files, splice when
+// either side is a pipe, read/write otherwise. If inOff is non-nil the
+// input is read from there (and it is advanced) instead of the file
+// position. Returns 0, or -1 on error or early end of input.
+int CopyRange(int in, off_t *inOff, int out, off_t len);
+
+// Creates every directory leading up to path's last '/', like mkdir -p.
+// path is modified while it works but left as it was.
+int MakeParents(char *path);
+
+// Big-endian stores, for building Mac headers.
+void Put16BE(Byte *p, UInt16 v);
+void Put32BE(Byte *p, UInt32 v);
+
+// Writes type/creator into the user.com.apple.FinderInfo xattr, keeping
+// the rest of it (flags, location). Netatalk and Samba's vfs_fruit serve
+// this to Mac clients. Returns 0, or -1 with errno set.
+int StampFinderInfo(const char *path, OSType type, OSType creator);
+
+#endif
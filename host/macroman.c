@@ -0,0 +1,108 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+
+#include "macroman.h"
+#include "../charset.h"
+
+// Appends one code point, returns the new length or len if it won't fit.
+static size_t PutUTF8(UInt32 c, char *out, size_t len, size_t size)
+{
+	if(c < 0x80 && len + 1 < size)
+		out[len++] = c;
+	else if(c < 0x800 && len + 2 < size)
+	{
+		out[len++] = 0xC0 | (c >> 6);
+		out[len++] = 0x80 | (c & 0x3F);
+	}
+	else if(c < 0x10000 && len + 3 < size)
+	{
+		out[len++] = 0xE0 | (c >> 12);
+		out[len++] = 0x80 | ((c >> 6) & 0x3F);
+		out[len++] = 0x80 | (c & 0x3F);
+	}
+	else if(c >= 0x10000 && len + 4 < size)
+	{
+		out[len++] = 0xF0 | (c >> 18);
+		out[len++] = 0x80 | ((c >> 12) & 0x3F);
+		out[len++] = 0x80 | ((c >> 6) & 0x3F);
+		out[len++] = 0x80 | (c & 0x3F);
+	}
+	return len;
+}
+
+void MacRomanToUTF8(const unsigned char *pName, char *out, size_t size)
+{
+	size_t len = 0;
+	short i;
+
+	for(i = 1; i <= pName[0]; i++)
+		len = PutUTF8(pName[i] < 0x80 ? pName[i] : kMacRomanHigh[pName[i] - 0x80], out, len, size);
+	out[len] = 0;
+}
+
+void UTF16BEToUTF8(const Byte *u, short len, char *out, size_t size)
+{
+	size_t n = 0;
+	UInt32 c, lo;
+	short i;
+
+	for(i = 0; i < len; i++)
+	{
+		c = (u[i * 2] << 8) | u[i * 2 + 1];
+		if(c >= 0xD800 && c < 0xDC00 && i + 1 < len)
+		{
+			lo = (u[i * 2 + 2] << 8) | u[i * 2 + 3];
+			if(lo >= 0xDC00 && lo < 0xE000)
+			{
+				c = 0x10000 + ((c - 0xD800) << 10) + (lo - 0xDC00);
+				i++;
+			}
+		}
+		n = PutUTF8(c, out, n, size);
+	}
+	out[n] = 0;
+}
+
+void UTF8ToMacRoman(const char *s, unsigned char *pName)
+{
+	const unsigned char *p = (const unsigned char *)s;
+	UInt32 c;
+	short n = 0, i, extra;
+
+	while(*p && n < 255)
+	{
+		c = *p++;
+		extra = 0;
+		if(c >= 0xF0)
+		{
+			c &= 0x07;
+			extra = 3;
+		}
+		else if(c >= 0xE0)
+		{
+			c &= 0x0F;
+			extra = 2;
+		}
+		else if(c >= 0xC0)
+		{
+			c &= 0x1F;
+			extra = 1;
+		}
+		for(; extra > 0 && (*p & 0xC0) == 0x80; extra--)
+			c = (c << 6) | (*p++ & 0x3F);
+
+		if(c >= 0x0300 && c < 0x0370)
+			continue;
+		if(c < 0x80)
+		{
+			pName[++n] = c;
+			continue;
+		}
+		for(i = 0; i < 128; i++)
+			if(kMacRomanHigh[i] == c)
+				break;
+		pName[++n] = i < 128 ? 0x80 + i : '?';
+	}
+	pName[0] = n;
+}
@@ -0,0 +1,20 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+#ifndef __MACROMAN_H__
+#define __MACROMAN_H__
+
+// Name conversions between the Mac side (Mac Roman Pascal strings, HFS+
+// UTF-16) and the host side (UTF-8 C strings).
+
+#include <MacTypes.h>
+#include <stddef.h>
+
+void MacRomanToUTF8(const unsigned char *pName, char *out, size_t size);
+// Big-endian UTF-16 as stored in HFS+ catalog keys.
+void UTF16BEToUTF8(const Byte *u, short len, char *out, size_t size);
+// Characters with no Mac Roman equivalent become '?', combining marks
+// are dropped. Good enough for extension matching and classic names.
+void UTF8ToMacRoman(const char *s, unsigned char *pName);
+
+#endif
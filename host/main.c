@@ -0,0 +1,109 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+
+#include "host.h"
+#include "io.h"
+#include "../stats.h"
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static void Usage()
+{
+	fprintf(stderr,
+		"usage: fix-a-fork-host <mode> [options] ...\n"
+		"\n"
+		"modes (all take -r log.jsonl|log.csv|log.bin to record every verdict):\n"
+		"  image [-n] [-j jobs] image...   fix files inside HFS/HFS+ disk images in place\n"
+		"  archive [-o out] [archive]      stamp types into a tar or zip, stdin to stdout\n"
+		"  export [-a] [-j jobs] [-o dir] path...\n"
+		"                                  wrap as MacBinary III (or AppleSingle)\n"
+		"  watch [-n] [-m] [-d ms] dir...  classify files as they arrive, until signalled\n"
+		"  pipe [-b | -s] [-t stats] < input\n"
+		"                                  classify NUL separated paths (or raw records)\n");
+}
+
+void FormatOSType(OSType t, char *out)
+{
+	short i;
+	for(i = 0; i < 4; i++)
+	{
+		char c = (t >> (24 - i * 8)) & 0xFF;
+		out[i] = (c >= 0x20 && c < 0x7F) ? c : '.';
+	}
+	out[4] = 0;
+}
+
+UInt32 HostMicros(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+OSErr WriteFdProc(void *refCon, const void *buf, long len)
+{
+	return WriteAll((int)(long)refCon, buf, len) ? -36 : noErr; // ioErr
+}
+
+ResultLog *OpenResultLog(const char *path)
+{
+	ResultLog *log = malloc(sizeof(ResultLog));
+	int fd = 1;
+
+	if(!log)
+		return nil;
+	if(strcmp(path, "-") != 0 && (fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0)
+	{
+		perror(path);
+		free(log);
+		return nil;
+	}
+	ResultLogOpen(log, strcmp(path, "-") == 0 ? kResultJSONL : ResultFormatForName(path), WriteFdProc, (void *)(long)fd, false);
+	return log;
+}
+
+OSErr CloseResultLog(ResultLog *log)
+{
+	OSErr err;
+	int fd;
+
+	if(!log)
+		return noErr;
+	err = ResultLogFlush(log);
+	fd = (int)(long)log->refCon;
+	if(fd != 1 && close(fd) && !err)
+		err = -36;
+	if(err)
+		fprintf(stderr, "results log: write failed, error %d\n", err);
+	free(log);
+	return err;
+}
+
+int main(int argc, char **argv)
+{
+	StatsInit(HostMicros);
+	if(argc < 2)
+	{
+		Usage();
+		return 2;
+	}
+	if(strcmp(argv[1], "image") == 0)
+		return ImageMain(argc - 1, argv + 1);
+	if(strcmp(argv[1], "archive") == 0)
+		return ArchiveMain(argc - 1, argv + 1);
+	if(strcmp(argv[1], "export") == 0)
+		return ExportMain(argc - 1, argv + 1);
+	if(strcmp(argv[1], "watch") == 0)
+		return WatchMain(argc - 1, argv + 1);
+	if(strcmp(argv[1], "pipe") == 0)
+		return PipeMain(argc - 1, argv + 1);
+
+	Usage();
+	return 2;
+}
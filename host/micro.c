@@ -0,0 +1,339 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+
+// fix-a-fork-micro: the detection core one function at a time.
+//
+//	fix-a-fork-micro [-n samples] [-t ms] [case...]
+//
+// Each case is calibrated so a sample runs for about -t milliseconds,
+// then timed -n times. ns/op is the median sample, with the fastest one
+// and the median absolute deviation beside it. Where perf_event_open is
+// allowed (see /proc/sys/kernel/perf_event_paranoid) the hardware
+// counters are summed over all samples and shown per op as well. Naming
+// cases only runs those whose name starts with one of them.
+//
+// Use it next to fix-a-fork-bench run: that says whether a change made
+// the tool faster, this says which function it was.
+
+#define _GNU_SOURCE
+#include "corpus.h"
+#include "../detect.h"
+#include "../file_ext.h"
+#include <linux/perf_event.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define kMaxCases 64
+#define kMaxSamples 1000
+
+enum {
+	kOpMagic,
+	kOpDetector,
+	kOpHeader,
+	kOpPad,
+	kOpExt,
+	kOpParse
+};
+
+typedef struct {
+	char name[32];
+	short op;
+	DetectProc proc;
+	SniffRec *s;
+	const char *ext;
+	const unsigned char *fName;
+} Case;
+
+static const struct {
+	UInt32 type;
+	UInt64 config;
+	const char *label;
+} kCounters[] = {
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles" },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instrs" },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, "br-miss" },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, "c-miss" },
+};
+
+#define kNumCounters ((int)(sizeof(kCounters) / sizeof(kCounters[0])))
+
+// In detect.c's table order, so DetectorName(i) names detectors[i].
+static const DetectProc detectors[kGenSignatures] = {
+	isBinHex4, isSit5, isSit15, isBinSit, isDsk4, isZip, isMar, isCpt, isDsk_1024
+};
+
+static SniffRec gHits[kGenSignatures];
+static SniffRec gMiss, gText, gPad;
+static Case gCases[kMaxCases];
+static int gNumCases;
+static int gCounterFds[kNumCounters];
+static volatile long gSink;
+
+static double Nanos()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// User-space counts for this thread only; -1 where the kernel or the
+// hardware won't give us one.
+static void OpenCounters()
+{
+	struct perf_event_attr attr;
+	int i;
+
+	for(i = 0; i < kNumCounters; i++)
+	{
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = kCounters[i].type;
+		attr.config = kCounters[i].config;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		gCounterFds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+	}
+}
+
+static void Counting(Boolean on)
+{
+	int i;
+
+	for(i = 0; i < kNumCounters; i++)
+	{
+		if(gCounterFds[i] < 0)
+			continue;
+		if(on)
+			ioctl(gCounterFds[i], PERF_EVENT_IOC_RESET, 0);
+		ioctl(gCounterFds[i], on ? PERF_EVENT_IOC_ENABLE : PERF_EVENT_IOC_DISABLE, 0);
+	}
+}
+
+static void AddCase(const char *name, short op)
+{
+	Case *c = &gCases[gNumCases++];
+
+	memset(c, 0, sizeof(*c));
+	snprintf(c->name, sizeof(c->name), "%s", name);
+	c->op = op;
+}
+
+static void Setup()
+{
+	// Pascal strings; no \p outside Retro68.
+	static const unsigned char shortName[] = "\005a.sit";
+	static const unsigned char longName[] = "\034A Long Classic File Name.SIT";
+	static const unsigned char noExt[] = "\015Read Me First";
+	static Byte buf[SNIFF_SIZE];
+	char name[32];
+	short i, last;
+
+	for(i = 0; i < kGenSignatures; i++)
+	{
+		CorpusFill(buf, SNIFF_SIZE, false);
+		CorpusSignature(buf, i);
+		memcpy(gHits[i].buf, buf, SNIFF_SIZE);
+		gHits[i].count = SNIFF_SIZE;
+	}
+	CorpusFill(gMiss.buf, SNIFF_SIZE, false);
+	gMiss.count = SNIFF_SIZE;
+	CorpusFill(gText.buf, SNIFF_SIZE, true);
+	gText.count = SNIFF_SIZE;
+
+	AddCase("magicCheck hit", kOpMagic);
+	gCases[gNumCases - 1].s = &gHits[kGenBinHex];
+	AddCase("magicCheck miss", kOpMagic);
+	gCases[gNumCases - 1].s = &gMiss;
+	for(i = 0; i < kGenSignatures; i++)
+	{
+		snprintf(name, sizeof(name), "is%s hit", DetectorName(i));
+		AddCase(name, kOpDetector);
+		gCases[gNumCases - 1].proc = detectors[i];
+		gCases[gNumCases - 1].s = &gHits[i];
+		snprintf(name, sizeof(name), "is%s miss", DetectorName(i));
+		AddCase(name, kOpDetector);
+		gCases[gNumCases - 1].proc = detectors[i];
+		gCases[gNumCases - 1].s = &gMiss;
+	}
+	// Every detector runs and fails, the common case for a whole batch.
+	AddCase("SniffHeader miss", kOpHeader);
+	gCases[gNumCases - 1].s = &gMiss;
+	AddCase("SniffHeader text", kOpHeader);
+	gCases[gNumCases - 1].s = &gText;
+	AddCase("SniffPad empty", kOpPad);
+	gCases[gNumCases - 1].s = &gPad;
+
+	// The table is searched in order, so its first and last entries are
+	// the best and worst hits; a miss compares against all of them.
+	for(last = 0; FileExtAt(last + 1, nil, nil); last++)
+		;
+	AddCase("CheckFileExt first", kOpExt);
+	gCases[gNumCases - 1].ext = FileExtAt(0, nil, nil);
+	AddCase("CheckFileExt last", kOpExt);
+	gCases[gNumCases - 1].ext = FileExtAt(last, nil, nil);
+	AddCase("CheckFileExt miss", kOpExt);
+	gCases[gNumCases - 1].ext = "qqq";
+
+	AddCase("ParseFileExt short", kOpParse);
+	gCases[gNumCases - 1].fName = shortName;
+	AddCase("ParseFileExt long", kOpParse);
+	gCases[gNumCases - 1].fName = longName;
+	AddCase("ParseFileExt none", kOpParse);
+	gCases[gNumCases - 1].fName = noExt;
+}
+
+// n calls of the case's function. The results are folded into gSink so
+// none of them can be left out.
+static void Run(Case *c, long n)
+{
+	OSType type, creator;
+	char ext[6];
+	long i, sink = 0;
+
+	switch(c->op)
+	{
+		case kOpMagic:
+			for(i = 0; i < n; i++)
+				sink += magicCheck(c->s, "BinHex 4.0", 10, 34, 'BINA', 'SITx');
+			break;
+		case kOpDetector:
+			for(i = 0; i < n; i++)
+				sink += c->proc(c->s);
+			break;
+		case kOpHeader:
+			for(i = 0; i < n; i++)
+				sink += SniffHeader(c->s);
+			break;
+		case kOpPad:
+			for(i = 0; i < n; i++)
+			{
+				c->s->count = 0;
+				SniffPad(c->s);
+				sink += c->s->buf[i & (SNIFF_SIZE - 1)];
+			}
+			break;
+		case kOpExt:
+			for(i = 0; i < n; i++)
+				sink += CheckFileExt(c->ext, &type, &creator);
+			break;
+		case kOpParse:
+			for(i = 0; i < n; i++)
+				sink += ParseFileExt(c->fName, ext);
+			break;
+	}
+	gSink += sink;
+}
+
+static int CompareDoubles(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return x < y ? -1 : x > y;
+}
+
+static void Measure(Case *c, int samples, double target)
+{
+	double times[kMaxSamples], dev[kMaxSamples], start, median;
+	long long totals[kNumCounters] = {0}, value;
+	long n = 1;
+	int i, j;
+
+	// Double n until a sample is long enough to time, then scale it to
+	// the target.
+	for(;;)
+	{
+		start = Nanos();
+		Run(c, n);
+		start = Nanos() - start;
+		if(start >= 1e6 || n >= 1L << 40)
+			break;
+		n *= 2;
+	}
+	if(start > 0)
+		n = n * (target / start) + 1;
+
+	for(i = 0; i < samples; i++)
+	{
+		Counting(true);
+		start = Nanos();
+		Run(c, n);
+		times[i] = (Nanos() - start) / n;
+		Counting(false);
+		for(j = 0; j < kNumCounters; j++)
+			if(gCounterFds[j] >= 0 && read(gCounterFds[j], &value, sizeof(value)) == sizeof(value))
+				totals[j] += value;
+	}
+	qsort(times, samples, sizeof(times[0]), CompareDoubles);
+	median = times[samples / 2];
+	for(i = 0; i < samples; i++)
+		dev[i] = times[i] > median ? times[i] - median : median - times[i];
+	qsort(dev, samples, sizeof(dev[0]), CompareDoubles);
+
+	printf("%-22s %9.2f %9.2f %6.1f%%", c->name, median, times[0],
+		median > 0 ? dev[samples / 2] * 100 / median : 0.0);
+	for(j = 0; j < kNumCounters; j++)
+	{
+		if(gCounterFds[j] < 0)
+			printf(" %9s", "-");
+		else
+			printf(" %9.2f", (double)totals[j] / ((double)n * samples));
+	}
+	printf("\n");
+}
+
+static Boolean Wanted(const Case *c, int argc, char **argv)
+{
+	int i;
+
+	if(argc == 0)
+		return true;
+	for(i = 0; i < argc; i++)
+		if(strncmp(c->name, argv[i], strlen(argv[i])) == 0)
+			return true;
+	return false;
+}
+
+int main(int argc, char **argv)
+{
+	int ch, samples = 21, i;
+	double ms = 5;
+
+	while((ch = getopt(argc, argv, "n:t:")) != -1)
+	{
+		switch(ch)
+		{
+			case 'n':
+				samples = atoi(optarg);
+				break;
+			case 't':
+				ms = atof(optarg);
+				break;
+			default:
+				goto usage;
+		}
+	}
+	if(samples < 1 || samples > kMaxSamples || ms <= 0)
+		goto usage;
+
+	Setup();
+	OpenCounters();
+	printf("%-22s %9s %9s %7s", "case", "ns/op", "min", "mad");
+	for(i = 0; i < kNumCounters; i++)
+		printf(" %9s", kCounters[i].label);
+	printf("\n");
+	for(i = 0; i < gNumCases; i++)
+		if(Wanted(&gCases[i], argc - optind, argv + optind))
+			Measure(&gCases[i], samples, ms * 1e6);
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: fix-a-fork-micro [-n samples] [-t ms] [case...]\n");
+	return 2;
+}
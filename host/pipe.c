@@ -0,0 +1,333 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+
+// pipe mode: classify a stream of inputs from stdin, for find -print0,
+// fd -0 and ingest scripts. The detection core is set up once and stays
+// warm however many inputs come through. Input is either NUL separated
+// paths, or (-b) raw records with no filesystem access at all:
+//
+//	UInt16 nameLen, name (UTF-8), UInt32 dataLen, data
+//
+// big-endian, where data is the start of the file; anything past
+// SNIFF_SIZE is skipped. Verdicts go to stdout in input order, flushed
+// whenever stdin has nothing more ready, so a slow producer still sees
+// answers right away.
+//
+// In FAF_STATS builds, -t writes stats.h's counters to a file at the
+// end, and again whenever the process gets SIGUSR1.
+
+#include "host.h"
+#include "io.h"
+#include "macroman.h"
+#include "../detect.h"
+#include "../stats.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define kInBufSize 131072	// room for the longest raw record header
+
+typedef struct {
+	Byte buf[kInBufSize];
+	long pos;
+	long len;
+	Boolean eof;
+} InBuf;
+
+static InBuf gIn;
+static SniffRec gSniff;
+static ResultLog *gLog = nil;
+static Boolean gStamp = false;
+static long gFiles = 0;
+static long gUnknown = 0;
+static long gErrors = 0;
+static const char *gStatsPath = nil;
+static volatile sig_atomic_t gStatsWanted = 0;
+
+static void WantStats(int sig)
+{
+	gStatsWanted = 1;
+}
+
+static void DumpStats()
+{
+	int fd;
+
+	gStatsWanted = 0;
+	if(!gStatsPath)
+		return;
+	fd = open(gStatsPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if(fd < 0)
+	{
+		perror(gStatsPath);
+		return;
+	}
+	if(StatsDump(WriteFdProc, (void *)(long)fd) || close(fd))
+		fprintf(stderr, "pipe: can't write %s\n", gStatsPath);
+}
+
+// Makes room and reads more; before blocking, pushes out what the
+// consumer is waiting for.
+static Boolean Refill()
+{
+	struct pollfd pfd = { 0, POLLIN, 0 };
+	ssize_t n;
+
+	if(gIn.pos)
+	{
+		memmove(gIn.buf, gIn.buf + gIn.pos, gIn.len - gIn.pos);
+		gIn.len -= gIn.pos;
+		gIn.pos = 0;
+	}
+	if(gIn.eof || gIn.len == kInBufSize)
+		return false;
+	if(poll(&pfd, 1, 0) == 0)
+	{
+		fflush(stdout);
+		if(gLog)
+			ResultLogFlush(gLog);
+	}
+	do {
+		n = read(0, gIn.buf + gIn.len, kInBufSize - gIn.len);
+		if(gStatsWanted)
+			DumpStats();
+	} while(n < 0 && errno == EINTR);
+	if(n <= 0)
+	{
+		gIn.eof = true;
+		return false;
+	}
+	gIn.len += n;
+	return true;
+}
+
+// Makes sure want bytes are buffered, unless input ends first.
+static Boolean Need(long want)
+{
+	while(gIn.len - gIn.pos < want)
+		if(!Refill())
+			return false;
+	return true;
+}
+
+static void Report(const char *path, Boolean found, int err, UInt32 start)
+{
+	char type[5], creator[5];
+	ResultRec rec = {0};
+
+	gFiles++;
+	if(err)
+	{
+		printf("%s\terror %d\n", path, err);
+		gErrors++;
+	}
+	else if(!found)
+	{
+		printf("%s\tunknown\n", path);
+		gUnknown++;
+	}
+	else
+	{
+		FormatOSType(gSniff.type, type);
+		FormatOSType(gSniff.creator, creator);
+		printf("%s\t%s/%s\t%s\n", path, type, creator, DetectorName(gSniff.detector));
+	}
+	if(gLog)
+	{
+		rec.path = path;
+		rec.fileID = gFiles;
+		rec.newType = found ? gSniff.type : 0;
+		rec.newCreator = found ? gSniff.creator : 0;
+		rec.detector = found ? gSniff.detector : kDetectNone;
+		rec.err = err;
+		rec.micros = HostMicros() - start;
+		ResultLogAppend(gLog, &rec);
+	}
+}
+
+static Boolean Classify(const char *name)
+{
+	unsigned char pName[256];
+	const char *base = strrchr(name, '/');
+	UInt32 mark = StatsNow();
+	Boolean found;
+
+	UTF8ToMacRoman(base ? base + 1 : name, pName);
+	SniffPad(&gSniff);
+	found = SniffFile(&gSniff, pName);
+	StatsStage(kStageSniff, mark);
+	StatsSniff(&gSniff);
+	return found && gSniff.type != 0 && gSniff.creator != 0;
+}
+
+static void ClassifyPath(const char *path)
+{
+	UInt32 start = HostMicros(), mark;
+	Boolean found = false;
+	struct stat st;
+	int fd, err = 0;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if(fd < 0 || fstat(fd, &st))
+		err = -43; // fnfErr
+	else if(!S_ISREG(st.st_mode))
+		err = -50; // paramErr, not a file
+	else
+	{
+		gSniff.count = pread(fd, gSniff.buf, SNIFF_SIZE, 0);
+		StatsStage(kStageRead, start);
+		if(gSniff.count < 0)
+			err = -36; // ioErr
+		else
+			found = Classify(path);
+	}
+	if(fd >= 0)
+		close(fd);
+	if(found && gStamp)
+	{
+		mark = StatsNow();
+		if(StampFinderInfo(path, gSniff.type, gSniff.creator))
+			err = -61; // wrPermErr
+		StatsStage(kStageSetInfo, mark);
+	}
+	Report(path, found, err, start);
+}
+
+static int ReadPaths()
+{
+	Byte *end;
+	char *path;
+
+	for(;;)
+	{
+		end = memchr(gIn.buf + gIn.pos, 0, gIn.len - gIn.pos);
+		if(!end)
+		{
+			if(Refill())
+				continue;
+			if(gIn.len - gIn.pos >= kInBufSize)
+			{
+				fprintf(stderr, "pipe: path longer than %d bytes\n", kInBufSize);
+				return 1;
+			}
+			// A last path without a NUL still counts.
+			if(gIn.len == gIn.pos)
+				return 0;
+			gIn.buf[gIn.len++] = 0;
+			continue;
+		}
+		path = (char *)gIn.buf + gIn.pos;
+		gIn.pos = end + 1 - gIn.buf;
+		if(*path)
+			ClassifyPath(path);
+	}
+}
+
+static int ReadRecords()
+{
+	char name[65536];
+	UInt32 dataLen, take, skip, start;
+	UInt16 nameLen;
+	Byte *p;
+
+	for(;;)
+	{
+		if(!Need(2))
+			return gIn.len == gIn.pos ? 0 : 1;
+		start = HostMicros();
+		p = gIn.buf + gIn.pos;
+		nameLen = (p[0] << 8) | p[1];
+		if(!Need(2 + nameLen + 4))
+			break;
+		p = gIn.buf + gIn.pos;
+		memcpy(name, p + 2, nameLen);
+		name[nameLen] = 0;
+		p += 2 + nameLen;
+		dataLen = ((UInt32)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+		gIn.pos += 2 + nameLen + 4;
+
+		take = dataLen < SNIFF_SIZE ? dataLen : SNIFF_SIZE;
+		if(!Need(take))
+			break;
+		memcpy(gSniff.buf, gIn.buf + gIn.pos, take);
+		gSniff.count = take;
+		gIn.pos += take;
+		for(skip = dataLen - take; skip; )
+		{
+			if(gIn.pos == gIn.len && !Refill())
+				goto truncated;
+			take = gIn.len - gIn.pos < skip ? gIn.len - gIn.pos : skip;
+			gIn.pos += take;
+			skip -= take;
+		}
+		Report(name, Classify(name), 0, start);
+	}
+truncated:
+	fprintf(stderr, "pipe: input ends in the middle of a record\n");
+	return 1;
+}
+
+int PipeMain(int argc, char **argv)
+{
+	Boolean raw = false;
+	struct sigaction sa;
+	int ch, err;
+
+	while((ch = getopt(argc, argv, "bsr:t:")) != -1)
+	{
+		switch(ch)
+		{
+			case 'b':
+				raw = true;
+				break;
+			case 's':
+				gStamp = true;
+				break;
+			case 'r':
+				gLog = OpenResultLog(optarg);
+				if(!gLog)
+					return 1;
+				break;
+			case 't':
+				if(!FAF_STATS)
+				{
+					fprintf(stderr, "pipe: -t needs a build with -DFAF_STATS=ON\n");
+					return 2;
+				}
+				gStatsPath = optarg;
+				break;
+			default:
+				fprintf(stderr, "usage: fix-a-fork-host pipe [-b | -s] [-r log] [-t stats] < input\n");
+				return 2;
+		}
+	}
+	if(raw && gStamp)
+	{
+		fprintf(stderr, "pipe: -s needs paths, raw records have no file to stamp\n");
+		return 2;
+	}
+	if(gStatsPath)
+	{
+		// No SA_RESTART, so a blocked read comes back to dump.
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = WantStats;
+		sigaction(SIGUSR1, &sa, nil);
+	}
+
+	err = raw ? ReadRecords() : ReadPaths();
+	DumpStats();
+	fflush(stdout);
+	fprintf(stderr, "%ld inputs, %ld unknown, %ld errors\n", gFiles, gUnknown, gErrors);
+	if(CloseResultLog(gLog))
+		err = 1;
+	return err || gErrors ? 1 : 0;
+}
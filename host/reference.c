@@ -0,0 +1,121 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+
+#include "reference.h"
+#include "../detect.h"
+#include "../file_ext.h"
+#include <stdbool.h>
+#include <string.h>
+
+typedef struct {
+	Byte buf[SNIFF_SIZE];	// zero past count
+	long count;
+	Verdict *v;
+} RefFile;
+
+static Boolean Magic(RefFile *f, const char *magic, short len, short offset, OSType type, OSType creator)
+{
+	if(memcmp(f->buf + offset, magic, len) != 0)
+		return false;
+	f->v->type = type;
+	f->v->creator = creator;
+	return true;
+}
+
+// A StuffIt 1.5-4.5 header at base, which isSit15/isBinSit leave with a
+// zero type/creator when only "SIT!" matches.
+static Boolean Sit(RefFile *f, short base, OSType type, OSType creator)
+{
+	if(!Magic(f, "SIT!", 4, base, 'SIT!', 'SIT!'))
+		return false;
+	f->v->type = 0;
+	f->v->creator = 0;
+	return (f->buf[base + 14] == 0x01 || f->buf[base + 14] == 0x02) && Magic(f, "rLau", 4, base + 10, type, creator);
+}
+
+// In detect.c's order; index is the detector number.
+static Boolean Header(RefFile *f, short index)
+{
+	switch(index)
+	{
+		case 0:
+			return Magic(f, "BinHex 4.0", 10, 34, 'BINA', 'SITx');
+		case 1:
+			return f->buf[82] == 0x05 && Magic(f, "StuffIt (c)1997", 15, 0, 'SITD', 'SIT!');
+		case 2:
+			return Sit(f, 0, 'SIT!', 'SIT!');
+		case 3:
+			return Sit(f, 128, 'BINA', 'SITx');
+		case 4:
+			return Magic(f, "\1\0", 2, 52, 'dImg', 'dCpy');
+		case 5:
+			return Magic(f, "PK", 2, 0, 'ZIP ', 'IZip');
+		case 6:
+			return Magic(f, "MAR", 3, 0, 'MARf', 'MARc');
+		case 7:
+			return Magic(f, "\1\1", 2, 0, 'PACT', 'CPCT');
+		case 8:
+			// Only files that fill both blocks.
+			return f->count >= SNIFF_SIZE && Magic(f, "BD", 2, BUF_SIZE, 'DDim', 'ddsk');
+	}
+	return false;
+}
+
+#define kRefHeaders 9
+
+// Up to 5 characters after the last '.', lowercased; a name of 5 or
+// fewer with no '.' is all extension.
+static Boolean Extension(const unsigned char *fName, char *ext)
+{
+	short dot, i;
+
+	for(dot = fName[0]; dot > 0 && fName[dot] != '.'; dot--)
+		;
+	if(dot == fName[0] || fName[0] - dot > 5)
+		return false;
+	for(i = dot + 1; i <= fName[0]; i++)
+		*ext++ = fName[i] >= 'A' && fName[i] <= 'Z' ? fName[i] + ('a' - 'A') : fName[i];
+	*ext = 0;
+	return true;
+}
+
+void RefClassify(const Byte *buf, long count, const unsigned char *fName, Verdict *v)
+{
+	static RefFile f;
+	OSType type, creator;
+	const char *entry;
+	char ext[6];
+	short i;
+
+	if(count < 0)
+		count = 0;
+	if(count > SNIFF_SIZE)
+		count = SNIFF_SIZE;
+	memset(&f, 0, sizeof(f));
+	memcpy(f.buf, buf, count);
+	f.count = count;
+	f.v = v;
+	memset(v, 0, sizeof(*v));
+	v->detector = kDetectNone;
+
+	for(i = 0; i < kRefHeaders; i++)
+		if(Header(&f, i))
+		{
+			v->found = true;
+			v->detector = i;
+			return;
+		}
+	if(!Extension(fName, ext))
+		return;
+	// First entry that matches exactly, case and all.
+	for(i = 0; (entry = FileExtAt(i, &type, &creator)) != nil; i++)
+		if(strcmp(entry, ext) == 0)
+		{
+			v->found = true;
+			v->type = type;
+			v->creator = creator;
+			v->detector = kDetectExt;
+			return;
+		}
+}
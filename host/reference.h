@@ -0,0 +1,25 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+#ifndef __REFERENCE_H__
+#define __REFERENCE_H__
+
+// The verdict rules as they stood before any of the detection core was
+// tuned, written as plainly as possible: byte compares, a linear walk
+// of the extension table. diff.c holds every engine to this. Don't
+// optimize it; change it only when the intended behaviour changes.
+
+#include <MacTypes.h>
+
+typedef struct {
+	Boolean found;
+	OSType type;
+	OSType creator;
+	short detector;		// as SniffRec.detector
+} Verdict;
+
+// buf holds count bytes of the data fork, anything past that is
+// ignored; fName is a Pascal string.
+void RefClassify(const Byte *buf, long count, const unsigned char *fName, Verdict *v);
+
+#endif
@@ -0,0 +1,454 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+
+// watch mode: a long running daemon that classifies files as they land
+// in watched trees and stamps their FinderInfo, for shares where an
+// ingest process drops files continuously. Trees are watched with
+// inotify (IN_CLOSE_WRITE, so files are only looked at once fully
+// written), or a whole mount with fanotify. Events are debounced into
+// batches; a cache of what was already classified means a file that is
+// rewritten unchanged, or seen twice, costs a stat and nothing more.
+
+#define _GNU_SOURCE
+#include "host.h"
+#include "io.h"
+#include "macroman.h"
+#include "../detect.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/fanotify.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define kMaxBatch 1024
+#define kMaxLatency 1000	// ms; a steady trickle still gets handled
+
+// What a file looked like when it was last classified.
+typedef struct {
+	dev_t dev;
+	ino_t ino;
+	struct timespec mtime;
+	off_t size;
+} SeenFile;
+
+typedef struct {
+	SeenFile *slots;
+	long count;
+	long size;	// power of two
+} SeenCache;
+
+typedef struct {
+	char *paths[kMaxBatch];
+	long count;
+} Batch;
+
+static Boolean gDryRun = false;
+static Boolean gInitialScan = false;
+static int gInotify = -1;
+static char **gWatchPaths;	// indexed by watch descriptor
+static int gMaxWatch = 0;
+static SeenCache gSeen;
+static SniffRec gSniff;
+static Batch gBatch;
+static volatile sig_atomic_t gStop = 0;
+static long gStamped = 0;
+static long gUnknown = 0;
+static long gErrors = 0;
+static ResultLog *gLog = nil;
+
+static void StopHandler(int sig)
+{
+	gStop = 1;
+}
+
+static long NowMillis()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static unsigned long SeenHash(dev_t dev, ino_t ino)
+{
+	return (ino * 0x9E3779B97F4A7C15ULL) ^ dev;
+}
+
+static SeenFile *SeenFind(struct stat *st)
+{
+	unsigned long i;
+	SeenFile *f;
+
+	if(!gSeen.size)
+		return nil;
+	for(i = SeenHash(st->st_dev, st->st_ino);; i++)
+	{
+		f = &gSeen.slots[i & (gSeen.size - 1)];
+		if(!f->ino || (f->ino == st->st_ino && f->dev == st->st_dev))
+			return f;
+	}
+}
+
+static void SeenAdd(struct stat *st)
+{
+	SeenFile *old = gSeen.slots, *f;
+	long oldSize = gSeen.size, i;
+
+	if((gSeen.count + 1) * 2 > gSeen.size)
+	{
+		gSeen.size = gSeen.size ? gSeen.size * 2 : 1024;
+		gSeen.slots = calloc(gSeen.size, sizeof(SeenFile));
+		if(!gSeen.slots)
+		{
+			// Forget everything rather than stop; it's only a cache.
+			gSeen.slots = old;
+			gSeen.size = oldSize;
+			memset(old, 0, sizeof(SeenFile) * oldSize);
+			gSeen.count = 0;
+		}
+		else
+		{
+			gSeen.count = 0;
+			for(i = 0; i < oldSize; i++)
+			{
+				if(!old[i].ino)
+					continue;
+				*SeenFind(&(struct stat){ .st_dev = old[i].dev, .st_ino = old[i].ino }) = old[i];
+				gSeen.count++;
+			}
+			free(old);
+		}
+	}
+	f = SeenFind(st);
+	if(!f->ino)
+		gSeen.count++;
+	f->dev = st->st_dev;
+	f->ino = st->st_ino;
+	f->mtime = st->st_mtim;
+	f->size = st->st_size;
+}
+
+static Boolean SeenUnchanged(struct stat *st)
+{
+	SeenFile *f = SeenFind(st);
+	return f && f->ino && f->size == st->st_size && f->mtime.tv_sec == st->st_mtim.tv_sec && f->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+static void ClassifyFile(const char *path)
+{
+	unsigned char pName[256];
+	char type[5], creator[5];
+	const char *base = strrchr(path, '/');
+	UInt32 start = HostMicros();
+	ResultRec rec = {0};
+	struct stat st;
+	Boolean found;
+	int fd, err = 0;
+
+	base = base ? base + 1 : path;
+	// AppleDouble companions and dot files are not ingest.
+	if(base[0] == '.')
+		return;
+	fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	if(fd < 0)
+		return;	// gone again before the batch ran
+	if(fstat(fd, &st) || !S_ISREG(st.st_mode) || SeenUnchanged(&st))
+	{
+		close(fd);
+		return;
+	}
+	gSniff.count = pread(fd, gSniff.buf, SNIFF_SIZE, 0);
+	close(fd);
+	UTF8ToMacRoman(base, pName);
+	SniffPad(&gSniff);
+	found = SniffFile(&gSniff, pName) && gSniff.type != 0 && gSniff.creator != 0;
+	SeenAdd(&st);
+
+	if(!found)
+	{
+		printf("%s\tunknown\n", path);
+		gUnknown++;
+	}
+	else if(!gDryRun && StampFinderInfo(path, gSniff.type, gSniff.creator))
+	{
+		err = errno;
+		printf("%s\terror %d\n", path, err);
+		gErrors++;
+	}
+	else
+	{
+		FormatOSType(gSniff.type, type);
+		FormatOSType(gSniff.creator, creator);
+		printf("%s\t%s/%s\t%s\n", path, type, creator, DetectorName(gSniff.detector));
+		gStamped++;
+	}
+	if(gLog)
+	{
+		rec.path = path;
+		rec.fileID = st.st_ino;
+		rec.newType = found ? gSniff.type : 0;
+		rec.newCreator = found ? gSniff.creator : 0;
+		rec.detector = found ? gSniff.detector : kDetectNone;
+		rec.err = err ? -36 : noErr; // ioErr
+		rec.micros = HostMicros() - start;
+		ResultLogAppend(gLog, &rec);
+	}
+}
+
+static void RunBatch()
+{
+	long i;
+
+	for(i = 0; i < gBatch.count; i++)
+	{
+		ClassifyFile(gBatch.paths[i]);
+		free(gBatch.paths[i]);
+	}
+	gBatch.count = 0;
+	fflush(stdout);
+	// Once per batch, so a daemon's log never lags far behind.
+	if(gLog)
+		ResultLogFlush(gLog);
+}
+
+static void Enqueue(const char *dir, const char *name)
+{
+	char path[PATH_MAX];
+	long i;
+
+	if(name)
+		snprintf(path, sizeof(path), "%s/%s", dir, name);
+	else
+		snprintf(path, sizeof(path), "%s", dir);
+	// Bursts repeat the same names; batches are small enough to scan.
+	for(i = 0; i < gBatch.count; i++)
+		if(strcmp(gBatch.paths[i], path) == 0)
+			return;
+	if(gBatch.count == kMaxBatch)
+		RunBatch();
+	gBatch.paths[gBatch.count] = strdup(path);
+	if(gBatch.paths[gBatch.count])
+		gBatch.count++;
+}
+
+static int AddWatch(const char *path)
+{
+	char **grown;
+	int wd = inotify_add_watch(gInotify, path, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR | IN_DONT_FOLLOW);
+
+	if(wd < 0)
+	{
+		fprintf(stderr, "watch: can't watch %s: %s\n", path, strerror(errno));
+		return 0;
+	}
+	if(wd >= gMaxWatch)
+	{
+		grown = realloc(gWatchPaths, sizeof(char *) * (wd + 64));
+		if(!grown)
+			return -1;
+		memset(grown + gMaxWatch, 0, sizeof(char *) * (wd + 64 - gMaxWatch));
+		gWatchPaths = grown;
+		gMaxWatch = wd + 64;
+	}
+	free(gWatchPaths[wd]);
+	gWatchPaths[wd] = strdup(path);
+	return 0;
+}
+
+// Watches every directory of a tree. Files already there are queued when
+// the tree appears after startup (a directory moved or copied in),
+// since their events happened before the watch existed.
+static int WalkProc(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+	if(flag == FTW_D)
+		return AddWatch(path);
+	if(flag == FTW_F && !gInitialScan)
+		Enqueue(path, nil);
+	return 0;
+}
+
+static void ReadInotify()
+{
+	char buf[65536] __attribute__((aligned(__alignof__(struct inotify_event))));
+	char path[PATH_MAX];
+	struct inotify_event *e;
+	ssize_t n;
+	char *p;
+
+	while((n = read(gInotify, buf, sizeof(buf))) > 0)
+	{
+		for(p = buf; p < buf + n; p += sizeof(struct inotify_event) + e->len)
+		{
+			e = (struct inotify_event *)p;
+			if(e->mask & IN_Q_OVERFLOW)
+				fprintf(stderr, "watch: event queue overflowed, some files were missed\n");
+			if(e->wd < 0 || e->wd >= gMaxWatch || !gWatchPaths[e->wd] || !e->len)
+				continue;
+			if(e->mask & IN_ISDIR)
+			{
+				if(e->mask & (IN_CREATE | IN_MOVED_TO))
+				{
+					snprintf(path, sizeof(path), "%s/%s", gWatchPaths[e->wd], e->name);
+					nftw(path, WalkProc, 16, FTW_PHYS);
+				}
+			}
+			else if(e->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+				Enqueue(gWatchPaths[e->wd], e->name);
+		}
+	}
+}
+
+static void ReadFanotify(int fan)
+{
+	char buf[8192], link[64], path[PATH_MAX];
+	struct fanotify_event_metadata *m;
+	ssize_t n, len;
+
+	while((n = read(fan, buf, sizeof(buf))) > 0)
+	{
+		for(m = (struct fanotify_event_metadata *)buf; FAN_EVENT_OK(m, n); m = FAN_EVENT_NEXT(m, n))
+		{
+			if(m->fd < 0)
+				continue;
+			snprintf(link, sizeof(link), "/proc/self/fd/%d", m->fd);
+			len = readlink(link, path, sizeof(path) - 1);
+			close(m->fd);
+			if(len <= 0)
+				continue;
+			path[len] = 0;
+			Enqueue(path, nil);
+		}
+	}
+}
+
+int WatchMain(int argc, char **argv)
+{
+	long debounce = 200, first = 0, last = 0, now, wait;
+	Boolean mount = false;
+	struct sigaction sa;
+	struct pollfd pfd;
+	int ch, i, fan = -1;
+
+	while((ch = getopt(argc, argv, "nmd:r:")) != -1)
+	{
+		switch(ch)
+		{
+			case 'n':
+				gDryRun = true;
+				break;
+			case 'm':
+				mount = true;
+				break;
+			case 'd':
+				debounce = atol(optarg);
+				break;
+			case 'r':
+				gLog = OpenResultLog(optarg);
+				if(!gLog)
+					return 1;
+				break;
+			default:
+				fprintf(stderr, "usage: fix-a-fork-host watch [-n] [-m] [-d ms] [-r log] dir...\n");
+				return 2;
+		}
+	}
+	if(optind == argc)
+	{
+		fprintf(stderr, "usage: fix-a-fork-host watch [-n] [-m] [-d ms] [-r log] dir...\n");
+		return 2;
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = StopHandler;
+	sigaction(SIGINT, &sa, nil);
+	sigaction(SIGTERM, &sa, nil);
+
+	if(mount)
+	{
+		// Whole mounts; needs CAP_SYS_ADMIN, but no per-directory watches.
+		fan = fanotify_init(FAN_CLASS_NOTIF | FAN_CLOEXEC | FAN_NONBLOCK, O_RDONLY | O_LARGEFILE);
+		if(fan < 0)
+		{
+			perror("watch: fanotify_init");
+			return 1;
+		}
+		for(i = optind; i < argc; i++)
+		{
+			if(fanotify_mark(fan, FAN_MARK_ADD | FAN_MARK_MOUNT, FAN_CLOSE_WRITE, AT_FDCWD, argv[i]))
+			{
+				perror(argv[i]);
+				return 1;
+			}
+		}
+		pfd.fd = fan;
+	}
+	else
+	{
+		gInotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if(gInotify < 0)
+		{
+			perror("watch: inotify_init1");
+			return 1;
+		}
+		gInitialScan = true;
+		for(i = optind; i < argc; i++)
+		{
+			if(nftw(argv[i], WalkProc, 16, FTW_PHYS))
+			{
+				fprintf(stderr, "watch: can't watch %s\n", argv[i]);
+				return 1;
+			}
+		}
+		gInitialScan = false;
+		pfd.fd = gInotify;
+	}
+	pfd.events = POLLIN;
+	fprintf(stderr, "watch: ready\n");
+
+	while(!gStop)
+	{
+		// Run the batch once things have been quiet for the debounce
+		// interval, or when it has been waiting too long regardless.
+		wait = -1;
+		if(gBatch.count)
+		{
+			now = NowMillis();
+			wait = last + debounce - now;
+			if(first + kMaxLatency - now < wait)
+				wait = first + kMaxLatency - now;
+			if(wait <= 0)
+			{
+				RunBatch();
+				continue;
+			}
+		}
+		if(poll(&pfd, 1, wait) <= 0)
+			continue;
+		now = NowMillis();
+		if(!gBatch.count)
+			first = now;
+		last = now;
+		if(fan >= 0)
+			ReadFanotify(fan);
+		else
+			ReadInotify();
+	}
+
+	RunBatch();
+	fprintf(stderr, "watch: %ld stamped, %ld unknown, %ld errors\n", gStamped, gUnknown, gErrors);
+	for(i = 0; i < gMaxWatch; i++)
+		free(gWatchPaths[i]);
+	free(gWatchPaths);
+	free(gSeen.slots);
+	return CloseResultLog(gLog) ? 1 : 0;
+}
@@ -0,0 +1,231 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+
+#include "main.h"
+#include "journal.h"
+#include <stdlib.h>
+
+// Fixed 16 byte records. Volumes are named by creation date, since a
+// vRefNum doesn't survive a restart.
+#define kJournalBegin 'bgin'	// a = identity, b = items, c = options
+#define kJournalItem 'item'		// a = item
+#define kJournalDir 'dir '		// a = volume date, b = dirID
+
+typedef struct {
+	OSType kind;
+	UInt32 a;
+	UInt32 b;
+	UInt32 c;
+} JournalRec;
+
+typedef struct {
+	UInt32 date;
+	UInt32 dirID;
+} DoneDir;
+
+static short gJournalRefNum = 0;
+static JournalRec gJournalBuf[kJournalRecs];
+static short gJournalCount = 0;
+static UInt32 gJournalFlushed = 0;
+// From the run being resumed, sorted for lookups.
+static DoneDir *gDoneDirs = nil;
+static long gNumDoneDirs = 0;
+static Byte *gDoneItems = nil;
+static long gNumItems = 0;
+static long gNumDoneItems = 0;
+static UInt32 Mix(UInt32 h, UInt32 v)
+{
+	return (h << 5 | h >> 27) ^ v;
+}
+
+// The items and options a run was started with.
+static UInt32 Identity(AEDescList *docList, long itemsInList)
+{
+	UInt32 h = itemsInList;
+	FSSpec fss;
+	long index;
+	short i;
+	Size actualSize;
+	AEKeyword keywd;
+	DescType returnedType;
+
+	for(index = 1; index <= itemsInList; index++)
+	{
+		if(AEGetNthPtr(docList, index, typeFSS, &keywd, &returnedType, (Ptr)&fss, sizeof(fss), &actualSize))
+			continue;
+		h = Mix(h, VolumeDate(fss.vRefNum));
+		h = Mix(h, fss.parID);
+		for(i = 0; i <= fss.name[0]; i++)
+			h = Mix(h, fss.name[i]);
+	}
+	return h;
+}
+
+static UInt32 Options()
+{
+	return gBatch.recursive | gBatch.genericOnly << 1 | gBatch.catSearch << 2 | gBatch.incremental << 3;
+}
+
+static int CompareDirs(const void *a, const void *b)
+{
+	const DoneDir *x = a, *y = b;
+
+	if(x->date != y->date)
+		return x->date < y->date ? -1 : 1;
+	return x->dirID < y->dirID ? -1 : x->dirID > y->dirID;
+}
+
+// Loads a previous run of the same batch. False if there isn't one.
+static Boolean Load(UInt32 identity, long itemsInList)
+{
+	JournalRec rec;
+	long count = sizeof(rec), eof = 0, max;
+
+	GetEOF(gJournalRefNum, &eof);
+	SetFPos(gJournalRefNum, fsFromStart, 0);
+	if(FSRead(gJournalRefNum, &count, &rec) || rec.kind != kJournalBegin
+		|| rec.a != identity || rec.b != (UInt32)itemsInList || rec.c != Options())
+		return false;
+	max = eof / sizeof(rec);
+	gDoneDirs = (DoneDir *)NewPtr(max * sizeof(DoneDir));
+	gDoneItems = (Byte *)NewPtrClear(itemsInList);
+	if(!gDoneDirs || !gDoneItems)
+		return false;
+	gNumItems = itemsInList;
+	// A record cut short by a crash is left out.
+	while(count = sizeof(rec), FSRead(gJournalRefNum, &count, &rec) == noErr)
+	{
+		if(rec.kind == kJournalItem && rec.a >= 1 && rec.a <= (UInt32)itemsInList)
+		{
+			gNumDoneItems += !gDoneItems[rec.a - 1];
+			gDoneItems[rec.a - 1] = true;
+		}
+		else if(rec.kind == kJournalDir)
+		{
+			gDoneDirs[gNumDoneDirs].date = rec.a;
+			gDoneDirs[gNumDoneDirs++].dirID = rec.b;
+		}
+	}
+	qsort(gDoneDirs, gNumDoneDirs, sizeof(DoneDir), CompareDirs);
+	SetFPos(gJournalRefNum, fsFromLEOF, 0);
+	return true;
+}
+
+static void Flush()
+{
+	long len = gJournalCount * sizeof(JournalRec);
+	ParamBlockRec pb;
+
+	gJournalFlushed = TickCount();
+	if(!gJournalCount)
+		return;
+	gJournalCount = 0;
+	if(FSWrite(gJournalRefNum, &len, gJournalBuf) != noErr)
+		return;
+	// Through the cache to the disk, so a crash doesn't lose it.
+	pb.ioParam.ioCompletion = nil;
+	pb.ioParam.ioRefNum = gJournalRefNum;
+	PBFlushFileSync(&pb);
+}
+
+static void Append(OSType kind, UInt32 a, UInt32 b, UInt32 c)
+{
+	JournalRec *rec;
+
+	if(!gJournalRefNum)
+		return;
+	rec = &gJournalBuf[gJournalCount++];
+	rec->kind = kind;
+	rec->a = a;
+	rec->b = b;
+	rec->c = c;
+	if(gJournalCount == kJournalRecs || TickCount() - gJournalFlushed >= kJournalTicks)
+		Flush();
+}
+
+static void Forget()
+{
+	if(gDoneDirs)
+		DisposePtr((Ptr)gDoneDirs);
+	if(gDoneItems)
+		DisposePtr((Ptr)gDoneItems);
+	gDoneDirs = nil;
+	gDoneItems = nil;
+	gNumDoneDirs = 0;
+	gNumItems = 0;
+	gNumDoneItems = 0;
+}
+
+long JournalBegin(AEDescList *docList, long itemsInList)
+{
+	UInt32 identity;
+	OSErr err;
+
+	Forget();
+	// A dry run changes nothing, so there's nothing to save.
+	if(gBatch.dryRun)
+		return 0;
+	err = HCreate(0, 0, "\pFix-a-Fork Journal", 'FAF ', 'FAFj');
+	if(err && err != dupFNErr)
+		return 0;
+	if(HOpen(0, 0, "\pFix-a-Fork Journal", fsRdWrPerm, &gJournalRefNum))
+	{
+		gJournalRefNum = 0;
+		return 0;
+	}
+	identity = Identity(docList, itemsInList);
+	if(!Load(identity, itemsInList))
+	{
+		Forget();
+		SetEOF(gJournalRefNum, 0);
+		SetFPos(gJournalRefNum, fsFromStart, 0);
+		Append(kJournalBegin, identity, itemsInList, Options());
+		Flush();
+	}
+	gJournalFlushed = TickCount();
+	return gNumDoneDirs + gNumDoneItems;
+}
+
+Boolean JournalItemDone(long item)
+{
+	return item >= 1 && item <= gNumItems && gDoneItems[item - 1];
+}
+
+Boolean JournalDirDone(short vRefNum, long dirID)
+{
+	DoneDir key;
+
+	if(!gNumDoneDirs)
+		return false;
+	key.date = VolumeDate(vRefNum);
+	key.dirID = dirID;
+	return bsearch(&key, gDoneDirs, gNumDoneDirs, sizeof(DoneDir), CompareDirs) != nil;
+}
+
+void JournalItem(long item)
+{
+	Append(kJournalItem, item, 0, 0);
+}
+
+void JournalDir(short vRefNum, long dirID)
+{
+	Append(kJournalDir, VolumeDate(vRefNum), dirID, 0);
+}
+
+void JournalEnd(Boolean finished)
+{
+	if(!gJournalRefNum)
+		return;
+	if(finished)
+	{
+		gJournalCount = 0;
+		SetEOF(gJournalRefNum, 0);
+	}
+	else
+		Flush();
+	FSClose(gJournalRefNum);
+	FlushVol(nil, 0);
+	gJournalRefNum = 0;
+	Forget();
+}
@@ -0,0 +1,33 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+#ifndef __JOURNAL_H__
+#define __JOURNAL_H__
+
+// Checkpoints for long batches, appended to "Fix-a-Fork Journal" next
+// to the app: which dropped items and which folders (with everything
+// below them) are finished. If a batch is stopped, or the Mac goes down,
+// running the same items again skips everything the journal lists. A
+// batch that finishes empties it. Records are buffered and written, and
+// flushed to disk, every kJournalTicks or kJournalRecs records.
+
+#include <MacTypes.h>
+#include <AppleEvents.h>
+
+#define kJournalTicks (10 * 60)
+#define kJournalRecs 64
+
+// Opens the journal for docList. If it holds an unfinished run of the
+// same items with the same options, that run is resumed; otherwise it
+// is started over. Returns how many folders and items will be skipped.
+long JournalBegin(AEDescList *docList, long itemsInList);
+// Whether the last run finished item (1-based) or folder dirID.
+Boolean JournalItemDone(long item);
+Boolean JournalDirDone(short vRefNum, long dirID);
+// Call once everything in the item or folder has been written.
+void JournalItem(long item);
+void JournalDir(short vRefNum, long dirID);
+// finished empties the journal; otherwise it's kept to resume from.
+void JournalEnd(Boolean finished);
+
+#endif
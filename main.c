@@ -3,13 +3,97 @@
 */
 
 #include "main.h"
-#include "file_ext.h"
-#include <Script.h>
 
 // Globals
-OSType gType;
-OSType gCreator;
+SniffRec gSniff;
 long gHasAppleEvents;
+Boolean gQuit = false;
+ResultLog gLog;
+short gLogRefNum = 0;
+static const BatchOptions kBatchDefaults = { false, true, false, false, false, nil };
+BatchOptions gBatch = { false, true, false, false, false, nil };
+// vRefNum -> creation date, for the last volume asked about.
+static short gDateVRefNum = 0;
+static UInt32 gDate = 0;
+
+OSErr WriteLogProc(void *refCon, const void *buf, long len)
+{
+	return FSWrite(*(short *)refCon, &len, buf);
+}
+
+// Every verdict is appended to a CSV log next to the app, so a big run
+// can be checked afterwards. Written through gLog's buffer, not per file.
+void OpenResultsLog()
+{
+	long eof = 0;
+	OSErr err;
+
+	err = HCreate(0, 0, "\pFix-a-Fork Log.csv", 'ttxt', 'TEXT');
+	if(err && err != dupFNErr)
+		return;
+	if(HOpen(0, 0, "\pFix-a-Fork Log.csv", fsWrPerm, &gLogRefNum))
+	{
+		gLogRefNum = 0;
+		return;
+	}
+	GetEOF(gLogRefNum, &eof);
+	SetFPos(gLogRefNum, fsFromLEOF, 0);
+	ResultLogOpen(&gLog, kResultCSV, WriteLogProc, &gLogRefNum, eof > 0);
+}
+
+void CloseResultsLog()
+{
+	if(!gLogRefNum)
+		return;
+	ResultLogFlush(&gLog);
+	FSClose(gLogRefNum);
+	FlushVol(nil, 0);
+	gLogRefNum = 0;
+}
+
+#if FAF_STATS
+static UInt32 StatsClock(void)
+{
+	UnsignedWide now;
+	Microseconds(&now);
+	return now.lo;
+}
+
+// 'FAF '/'stat': replaces the last dump.
+pascal OSErr DoDumpStats(AppleEvent *event, AppleEvent *reply, long handlerRefcon)
+{
+	short refNum;
+	OSErr err;
+
+	err = HCreate(0, 0, "\pFix-a-Fork Stats.txt", 'ttxt', 'TEXT');
+	if(err && err != dupFNErr)
+		return err;
+	err = HOpen(0, 0, "\pFix-a-Fork Stats.txt", fsWrPerm, &refNum);
+	if(err)
+		return err;
+	SetEOF(refNum, 0);
+	err = StatsDump(WriteLogProc, &refNum);
+	FSClose(refNum);
+	FlushVol(nil, 0);
+	return err;
+}
+#endif
+
+// A volume's creation date, which names it across restarts.
+UInt32 VolumeDate(short vRefNum)
+{
+	HParamBlockRec pb;
+
+	if(vRefNum == gDateVRefNum && gDate)
+		return gDate;
+	memset(&pb, 0, sizeof(pb));
+	pb.volumeParam.ioVRefNum = vRefNum;
+	if(PBHGetVInfoSync(&pb) != noErr)
+		return 0;
+	gDateVRefNum = vRefNum;
+	gDate = pb.volumeParam.ioVCrDate;
+	return gDate;
+}
 
 // Change the modification date on the parent folder so the 
 // Finder notices a change.
@@ -18,6 +102,7 @@ OSErr TouchFolder(short vRefNum, long parID)
 	CInfoPBRec rec;
 	Str63 name; 
 	short err;
+	UInt32 mark = StatsNow();
 	
 	rec.hFileInfo.ioNamePtr = name;
 	name[0]=0;
@@ -36,62 +121,467 @@ OSErr TouchFolder(short vRefNum, long parID)
 	rec.hFileInfo.ioFVersNum = 0;
 	rec.hFileInfo.ioNamePtr[0] = 0;
 	err = PBSetCatInfoSync(&rec);
+	StatsStage(kStageTouch, mark);
 	return err;
 }
 
-pascal OSErr DoOpenDoc(AppleEvent *event, AppleEvent *reply, long handlerRefcon)
+// One record per file for 'fixf': name, the type/creator it has (or
+// would have, on a dry run), the detector that fired and any error.
+void AddVerdict(const unsigned char *fName, const ResultRec *rec, OSErr err)
+{
+	AERecord verdict;
+	const char *detector;
+
+	if(!gBatch.verdicts || AECreateList(nil, 0, true, &verdict) != noErr)
+		return;
+	AEPutKeyPtr(&verdict, keyFAFName, typeChar, fName + 1, fName[0]);
+	if(rec)
+	{
+		AEPutKeyPtr(&verdict, keyFAFType, typeType, &rec->newType, sizeof(OSType));
+		AEPutKeyPtr(&verdict, keyFAFCreator, typeType, &rec->newCreator, sizeof(OSType));
+		detector = DetectorName(rec->detector);
+		AEPutKeyPtr(&verdict, keyFAFDetector, typeChar, detector, strlen(detector));
+	}
+	AEPutKeyPtr(&verdict, keyErrorNumber, typeShortInteger, &err, sizeof(err));
+	AEPutDesc(gBatch.verdicts, 0, &verdict);
+	AEDisposeDesc(&verdict);
+}
+
+static OSErr FixFolder(short vRefNum, long dirID, long *done);
+static OSErr FixSubfolders(short vRefNum, long dirID, long *done);
+static OSErr FixVolume(short vRefNum, long *done);
+
+// One dropped or chosen item: a file is fixed, a folder has everything
+// inside it fixed. Failures inside a folder go to the summary and the
+// walk carries on; userCanceledErr means Cmd-period.
+static OSErr FixItem(FSSpec *fss, long *done)
+{
+	CInfoPBRec pb;
+	short fRefNum;
+	OSErr err;
+
+	pb.hFileInfo.ioNamePtr = fss->name;
+	pb.hFileInfo.ioVRefNum = fss->vRefNum;
+	pb.hFileInfo.ioDirID = fss->parID;
+	pb.hFileInfo.ioFDirIndex = 0;
+	err = PBGetCatInfoSync(&pb);
+	if(!err && (pb.hFileInfo.ioFlAttrib & ioDirMask))
+	{
+		if(gBatch.catSearch && pb.dirInfo.ioDrDirID == fsRtDirID && CatSearchAvailable(fss->vRefNum))
+			err = FixVolume(fss->vRefNum, done);
+		else if(!JournalDirDone(fss->vRefNum, pb.dirInfo.ioDrDirID))
+		{
+			if(RescanFolder(fss->vRefNum, &pb))
+				err = FixSubfolders(fss->vRefNum, pb.dirInfo.ioDrDirID, done);
+			else
+			{
+				// The folder itself was already counted.
+				ProgressAdd(pb.dirInfo.ioDrNmFls);
+				err = FixFolder(fss->vRefNum, pb.dirInfo.ioDrDirID, done);
+			}
+			if(!err)
+				JournalDir(fss->vRefNum, pb.dirInfo.ioDrDirID);
+		}
+	}
+	else if(!err)
+	{
+		switch(Prefilter(&pb))
+		{
+			case kPrefilterSkip:
+				SkipFile(fss, &pb);
+				break;
+			case kPrefilterName:
+				err = openFile(fss->name, 0, fss->vRefNum, fss->parID);
+				break;
+			default:
+				err = FSpOpenDF(fss, fsRdPerm, &fRefNum);
+				if(!err)
+					err = openFile(fss->name, fRefNum, fss->vRefNum, fss->parID);
+				break;
+		}
+	}
+	if(err && err != userCanceledErr)
+	{
+		RescanFailed(fss->vRefNum, fss->parID);
+		SummaryAdd(fss->name, kSummaryOpenFailed, err);
+		AddVerdict(fss->name, nil, err);
+	}
+	if(err != userCanceledErr && !ProgressStep(++*done))
+		err = userCanceledErr;
+	return err;
+}
+
+static OSErr FixFolder(short vRefNum, long dirID, long *done)
 {
+	CInfoPBRec pb;
 	FSSpec fss;
-	AEDescList docList;
-	OSErr err = noErr;
-	long index, itemsInList;
+	short index;
+	OSErr err;
+
+	for(index = 1; ; index++)
+	{
+		fss.vRefNum = vRefNum;
+		fss.parID = dirID;
+		fss.name[0] = 0;
+		pb.hFileInfo.ioNamePtr = fss.name;
+		pb.hFileInfo.ioVRefNum = vRefNum;
+		pb.hFileInfo.ioDirID = dirID;
+		pb.hFileInfo.ioFDirIndex = index;
+		if(PBGetCatInfoSync(&pb) != noErr)
+			return noErr;	// fnfErr past the last item
+		if((pb.hFileInfo.ioFlAttrib & ioDirMask) && !gBatch.recursive)
+		{
+			++*done;
+			continue;
+		}
+		if(FixItem(&fss, done) == userCanceledErr)
+			return userCanceledErr;
+	}
+}
+
+// A folder unchanged since the last run: none of its files are looked
+// at, only the subfolders it had then, found by dirID.
+static OSErr FixSubfolders(short vRefNum, long dirID, long *done)
+{
+	CInfoPBRec pb;
+	FSSpec fss;
+	long cursor = 0, subID;
+
+	while(RescanNextChild(vRefNum, dirID, &cursor, &subID))
+	{
+		pb.dirInfo.ioNamePtr = fss.name;
+		pb.dirInfo.ioVRefNum = vRefNum;
+		pb.dirInfo.ioDrDirID = subID;
+		pb.dirInfo.ioFDirIndex = -1;
+		// Gone, or moved out since.
+		if(PBGetCatInfoSync(&pb) != noErr || pb.dirInfo.ioDrParID != dirID)
+			continue;
+		fss.vRefNum = vRefNum;
+		fss.parID = dirID;
+		ProgressAdd(1);
+		if(FixItem(&fss, done) == userCanceledErr)
+			return userCanceledErr;
+	}
+	return noErr;
+}
+
+static Boolean SearchIdle(void *refCon)
+{
+	return ProgressStep(*(long *)refCon);
+}
+
+// Only the files the catalog search turns up, see catsearch.h.
+static OSErr FixVolume(short vRefNum, long *done)
+{
+	Handle found = NewHandle(0);
+	long offset = 0, count = 0;
+	FSSpec fss;
+	OSErr err;
+
+	if(!found)
+		return memFullErr;
+	err = CatSearchGeneric(vRefNum, found, &count, SearchIdle, done);
+	if(!err)
+	{
+		ProgressAdd(count);
+		while(CatSearchNext(found, &offset, vRefNum, &fss))
+			if(FixItem(&fss, done) == userCanceledErr)
+			{
+				err = userCanceledErr;
+				break;
+			}
+	}
+	DisposeHandle(found);
+	return err;
+}
+
+// One item after another on the main thread, for systems without the
+// Thread Manager.
+static OSErr FixSerial(AEDescList *docList, long itemsInList, OSErr *itemErr)
+{
+	FSSpec fss;
+	OSErr err;
+	long index, done = 0;
 	Size actualSize;
 	AEKeyword keywd;
 	DescType returnedType;
-	short fRefNum = 0;
+
+	for(index = 1; index <= itemsInList; index++)
+	{
+		if(JournalItemDone(index))
+		{
+			ProgressStep(++done);
+			continue;
+		}
+		err = AEGetNthPtr(docList, index, typeFSS, &keywd, &returnedType, (Ptr)&fss, sizeof(fss), &actualSize);
+		if(!err)
+			err = FixItem(&fss, &done);
+		if(err == userCanceledErr)
+		{
+			for(; index <= itemsInList; index++)
+				itemErr[index - 1] = userCanceledErr;
+			return userCanceledErr;
+		}
+		itemErr[index - 1] = err;
+		JournalItem(index);
+	}
+	return noErr;
+}
+
+// The batch pipeline behind both drag and drop and the Open dialog.
+// Every item is tried, whatever happened to the ones before it. If
+// results isn't nil it gets one error code per item, in order. Returns
+// the first error, if any.
+OSErr FixDocList(AEDescList *docList, AEDescList *results)
+{
+	OSErr err, first = noErr, *itemErr;
+	long index, itemsInList, resumed;
+	SInt16 code;
+
+	err = AECountItems(docList, &itemsInList);
+	if(err != noErr) return err;
+	itemErr = (OSErr *)NewPtrClear(itemsInList * sizeof(OSErr));
+	if(!itemErr) return memFullErr;
+
+	SummaryBegin();
+	ProgressBegin(itemsInList);
+	gDateVRefNum = 0;
+	resumed = JournalBegin(docList, itemsInList);
+	if(resumed)
+		SummaryResumed(resumed);
+	RescanBegin();
+	err = PipelineAvailable() ? PipelineRun(docList, itemsInList, itemErr) : unimpErr;
+	// Without threads, or if they couldn't be started.
+	if(err != noErr && err != userCanceledErr)
+		err = FixSerial(docList, itemsInList, itemErr);
+	if(err == userCanceledErr)
+		SummaryCancelled(ProgressRemaining());
+	JournalEnd(err != userCanceledErr);
+	// A resumed run didn't see the folders it skipped.
+	RescanEnd(err != userCanceledErr && !resumed);
+	ProgressEnd();
+	SummaryEnd();
+
+	for(index = 0; index < itemsInList; index++)
+	{
+		if(itemErr[index] && !first)
+			first = itemErr[index];
+		if(results)
+		{
+			code = itemErr[index];
+			AEPutPtr(results, index + 1, typeShortInteger, &code, sizeof(code));
+		}
+	}
+	DisposePtr((Ptr)itemErr);
+	return first;
+}
+
+pascal OSErr DoOpenDoc(AppleEvent *event, AppleEvent *reply, long handlerRefcon)
+{
+	AEDescList docList, results, *resultsPtr = nil;
+	OSErr err;
 	
 	err = AEGetParamDesc(event, keyDirectObject, typeAEList, &docList);
 	if(err != noErr) return err;
-	err = AECountItems(&docList, &itemsInList);
+	// A sender that waits for the reply gets the per-item codes as its
+	// direct object; the Finder doesn't ask for one.
+	if(reply->descriptorType != typeNull && AECreateList(nil, 0, false, &results) == noErr)
+		resultsPtr = &results;
+	err = FixDocList(&docList, resultsPtr);
+	if(resultsPtr)
+	{
+		AEPutParamDesc(reply, keyDirectObject, resultsPtr);
+		AEDisposeDesc(resultsPtr);
+	}
+	AEDisposeDesc(&docList);
+	return err;
+}
+
+static Boolean GetFlag(AppleEvent *event, AEKeyword key, Boolean flag)
+{
+	DescType type;
+	Size size;
+
+	AEGetParamPtr(event, key, typeBoolean, &type, &flag, sizeof(flag), &size);
+	return flag;
+}
+
+// 'FAF '/'fixf': like 'odoc', with options, and a verdict per file in
+// the reply. Folders are walked, into subfolders only with recursive.
+pascal OSErr DoFixFiles(AppleEvent *event, AppleEvent *reply, long handlerRefcon)
+{
+	AEDescList docList, verdicts;
+	OSErr err;
+
+	err = AEGetParamDesc(event, keyDirectObject, typeAEList, &docList);
 	if(err != noErr) return err;
-	
-	for(index = 1; index <= itemsInList; index++)
+	gBatch = kBatchDefaults;
+	gBatch.dryRun = GetFlag(event, keyFAFDryRun, false);
+	gBatch.recursive = GetFlag(event, keyFAFRecursive, false);
+	gBatch.genericOnly = GetFlag(event, keyFAFGenericOnly, false);
+	gBatch.catSearch = GetFlag(event, keyFAFCatSearch, false);
+	// The search only turns up generic files, so the rest of the batch
+	// is held to the same rule rather than quietly doing more or less.
+	if(gBatch.catSearch)
+		gBatch.genericOnly = true;
+	gBatch.incremental = GetFlag(event, keyFAFIncremental, false);
+	if(reply->descriptorType != typeNull && AECreateList(nil, 0, false, &verdicts) == noErr)
+		gBatch.verdicts = &verdicts;
+	err = FixDocList(&docList, nil);
+	if(gBatch.verdicts)
 	{
-		err = AEGetNthPtr(&docList, index, typeFSS, &keywd, &returnedType, (Ptr)&fss, sizeof(fss), &actualSize);
-		if(err) return err;
-
-		err = FSpOpenDF(&fss, fsRdPerm, &fRefNum);
-		if(err) return err;
-		
-		err = openFile(fss.name, fRefNum, fss.vRefNum, fss.parID);
-		if(err) 
-			return err;
-		else
-			gHandledByDnD = true;
+		AEPutParamDesc(reply, keyDirectObject, &verdicts);
+		AEDisposeDesc(&verdicts);
 	}
+	gBatch = kBatchDefaults;
 	AEDisposeDesc(&docList);
+	return err;
+}
+
+// Sent instead of 'odoc' when launched without anything dropped.
+pascal OSErr DoOpenApp(AppleEvent *event, AppleEvent *reply, long handlerRefcon)
+{
+#if !FAF_SERVER
+	OpenFileDialog();
+#endif
 	return noErr;
 }
 
-void InstallEventHandlers()
+pascal OSErr DoQuitApp(AppleEvent *event, AppleEvent *reply, long handlerRefcon)
+{
+	gQuit = true;
+	return noErr;
+}
+
+// No more waiting for 'odoc' to turn up: 'oapp' or 'odoc' arrives as
+// the first event, and anything dropped later is handled by the same
+// handlers for as long as the app runs.
+Boolean InstallEventHandlers()
+{
+	if(Gestalt(gestaltAppleEventsAttr, &gHasAppleEvents) != noErr)
+		return false;
+	AEInstallEventHandler(kCoreEventClass, kAEOpenApplication, NewAEEventHandlerUPP(&DoOpenApp), 0L, false);
+	AEInstallEventHandler(kCoreEventClass, kAEOpenDocuments, NewAEEventHandlerUPP(&DoOpenDoc), 0L, false);
+	AEInstallEventHandler(kCoreEventClass, kAEQuitApplication, NewAEEventHandlerUPP(&DoQuitApp), 0L, false);
+	AEInstallEventHandler(kFAFEventClass, kFAFFixFiles, NewAEEventHandlerUPP(&DoFixFiles), 0L, false);
+#if FAF_STATS
+	AEInstallEventHandler(kFAFEventClass, kFAFDumpStats, NewAEEventHandlerUPP(&DoDumpStats), 0L, false);
+#endif
+	return true;
+}
+
+#if FAF_SERVER
+// Faceless: no menus or windows, just Apple Events until 'quit'.
+void RunEventLoop()
 {
 	EventRecord event;
-	OSErr err = 0;
-	short i = 0;
-	
-	if(Gestalt(gestaltAppleEventsAttr, &gHasAppleEvents) == noErr)
+
+	while(!gQuit)
+		if(WaitNextEvent(highLevelEventMask, &event, kSleepTicks, nil) && event.what == kHighLevelEvent)
+			AEProcessAppleEvent(&event);
+}
+#else
+void SetUpMenus()
+{
+	MenuHandle menu;
+
+	menu = NewMenu(kAppleMenu, "\p\024");
+	AppendResMenu(menu, 'DRVR');
+	InsertMenu(menu, 0);
+	menu = NewMenu(kFileMenu, "\pFile");
+	AppendMenu(menu, "\pOpen\311/O;Save Summary\311/S;Close/W;(-;Quit/Q");
+	InsertMenu(menu, 0);
+	AdjustMenus();
+	DrawMenuBar();
+}
+
+// Save and Close only apply to the summary window.
+void AdjustMenus()
+{
+	MenuHandle menu = GetMenuHandle(kFileMenu);
+
+	if(SummaryIsOpen())
 	{
-		AEInstallEventHandler(kCoreEventClass, kAEOpenDocuments, NewAEEventHandlerUPP(&DoOpenDoc), 0L, false);
-	} else {
-		return;
+		EnableMenuItem(menu, kFileSave);
+		EnableMenuItem(menu, kFileClose);
+	}
+	else
+	{
+		DisableMenuItem(menu, kFileSave);
+		DisableMenuItem(menu, kFileClose);
+	}
+}
+
+void DoMenu(long choice)
+{
+	short menu = HiWord(choice), item = LoWord(choice);
+	Str255 name;
+
+	if(menu == kAppleMenu)
+	{
+		GetMenuItemText(GetMenuHandle(kAppleMenu), item, name);
+		OpenDeskAcc(name);
+	}
+	else if(menu == kFileMenu)
+	{
+		switch(item)
+		{
+			case kFileOpen:
+				OpenFileDialog();
+				break;
+			case kFileSave:
+				SummarySave();
+				break;
+			case kFileClose:
+				SummaryClose();
+				break;
+			case kFileQuit:
+				gQuit = true;
+				break;
+		}
+	}
+	HiliteMenu(0);
+}
+
+void RunEventLoop()
+{
+	EventRecord event;
+	WindowPtr window;
+
+	while(!gQuit)
+	{
+		if(!WaitNextEvent(everyEvent, &event, kSleepTicks, nil))
+			continue;
+		if(SummaryEvent(&event))
+			continue;
+		switch(event.what)
+		{
+			case kHighLevelEvent:
+				AEProcessAppleEvent(&event);
+				break;
+			case mouseDown:
+				switch(FindWindow(event.where, &window))
+				{
+					case inMenuBar:
+						AdjustMenus();
+						DoMenu(MenuSelect(event.where));
+						break;
+					case inSysWindow:
+						SystemClick(&event, window);
+						break;
+				}
+				break;
+			case keyDown:
+				if(event.modifiers & cmdKey)
+				{
+					AdjustMenus();
+					DoMenu(MenuKey(event.message & charCodeMask));
+				}
+				break;
+		}
 	}
-	do {
-		WaitNextEvent(highLevelEventMask, &event, 30, 0);
-		i = i+1;
-	} while(event.what != kHighLevelEvent && i < 5);
-	if(event.what == kHighLevelEvent)
-		AEProcessAppleEvent(&event);
 }
+#endif
 
 OSErr MyGetWDInfo(short wdRefNum, short *vRefNum, long *dirID, long *procID)
 {
@@ -107,225 +597,331 @@ OSErr MyGetWDInfo(short wdRefNum, short *vRefNum, long *dirID, long *procID)
 	return result;
 }
 
-void OpenFileDialog()
+// Without Navigation Services: one file per dialog.
+static void SFOpenDialog()
 {
 	long dirID = 0, procID = 0;
 	short volRefNum = 0;
 	SFReply tr = {0};
 	short fRefNum = 0;
+	OSErr err;
 	
 	Point where;
 	where.h = 100;
 	where.v = 50;
 
+	SummaryBegin();
 	do {
 		SFGetFile(where, nil, nil, -1, nil, nil, &tr);
 		if(tr.good)
 		{
 			MyGetWDInfo(tr.vRefNum, &volRefNum, &dirID, &procID);
-			HOpen(tr.vRefNum, dirID, tr.fName, fsRdPerm, &fRefNum);
-			openFile(tr.fName, fRefNum, volRefNum, dirID);
+			err = HOpen(tr.vRefNum, dirID, tr.fName, fsRdPerm, &fRefNum);
+			if(!err)
+				err = openFile(tr.fName, fRefNum, volRefNum, dirID);
+			if(err)
+				SummaryAdd(tr.fName, kSummaryOpenFailed, err);
 		}
 	} while(tr.good);
+	SummaryEnd();
 }
 
-OSErr openFile(unsigned char *fName, short fRefNum, short vRefNum, long dirID)
+#if TARGET_CPU_68K
+// 68K code has no Navigation Services glue to link against.
+void OpenFileDialog()
 {
-	OSErr err = noErr;
-	Str255 errString;
-	long count = BUF_SIZE;
-	FInfo fi = {0};
-	Boolean found = false;
-	char ext[5] = {0};
-	short i = 0, j = 0;
+	SFOpenDialog();
+}
+#else
+#if !TARGET_API_MAC_CARBON
+// Keeps the summary window drawn while the dialog is up.
+static pascal void NavEvent(NavEventCallbackMessage message, NavCBRecPtr params, NavCallBackUserData refCon)
+{
+	if(message == kNavCBEvent)
+		SummaryEvent(params->eventData.eventDataParms.event);
+}
+#endif
 
-	err = FSRead(fRefNum, &count, gBuf);
-	// eofErr == partial read, probably small file, ok to continue.
-	if(err && err != eofErr) return err;
-	// Check for magic in first 1024 bytes
-	if(isBinHex4())
-		found = true;
-	else if(isSit5())
-		found = true;
-	else if(isSit15())
-		found = true;
-	else if(isBinSit())
-		found = true;
-	else if(isDsk4())
-		found = true;
-	else if(isZip())
-		found = true;
-	else if(isMar())
-		found = true;
-	else if(isCpt())
-		found = true;
-		
-	// Checks @ 1024
-	if(!found && count >= 2048)
-	{
-		SetFPos(fRefNum, fsFromStart, 1024);
-		FSRead(fRefNum, &count, gBuf);
+#if WEAK_IMPORTS
+WeakProc(NavLibraryVersion);
+WeakProc(NavServicesCanRun);
+WeakProc(NavGetDefaultDialogOptions);
+WeakProc(NavChooseObject);
+WeakProc(NavDisposeReply);
 
-		if(isDsk_1024())
-			found = true;
-	}
-	
-	if(!found)
+static const WeakImportRec kNavImports[] = {
+	WeakRec(NavLibraryVersion),
+	WeakRec(NavServicesCanRun),
+	WeakRec(NavGetDefaultDialogOptions),
+	WeakRec(NavChooseObject),
+	WeakRec(NavDisposeReply)
+};
+
+#define NavLibraryVersion (*gWeakNavLibraryVersion)
+#define NavServicesCanRun (*gWeakNavServicesCanRun)
+// The headers' version tests NavLibraryVersion's address, which would
+// import it after all.
+#undef NavServicesAvailable
+#define NavServicesAvailable() (NavLibraryVersion() != 0 && NavServicesCanRun())
+#define NavGetDefaultDialogOptions (*gWeakNavGetDefaultDialogOptions)
+#define NavChooseObject (*gWeakNavChooseObject)
+#define NavDisposeReply (*gWeakNavDisposeReply)
+#endif
+
+// Any number of files and folders in one go, through the same pipeline
+// as a drop.
+void OpenFileDialog()
+{
+	NavDialogOptions options;
+	NavReplyRecord reply;
+	NavEventUPP eventUPP = nil;
+
+#if !TARGET_API_MAC_CARBON
+	if(!gWeakNavServicesCanRun)
+		WeakImport("\pNavigationLib", kNavImports, sizeof(kNavImports) / sizeof(kNavImports[0]));
+	if(!gWeakNavServicesCanRun || !NavServicesAvailable())
 	{
-		for(i = fName[0]; i > 0; i--)
-			if(fName[i] == '.')
-				break;
-		if(i != fName[0] && (fName[0] - i) <= 5) // There is an extension
-		{
-			i = i + 1; // increment to avoid '.'
-			// Parse file extension
-			for(; i <= fName[0]; i++)
-				ext[j++] = fName[i];
-			LowerText(ext, StringLen(ext));
-			found = CheckFileExt(ext, &gType, &gCreator);
-		}
+		SFOpenDialog();
+		return;
 	}
-		
-	if(found)
+	eventUPP = NewNavEventUPP(NavEvent);
+#endif
+	NavGetDefaultDialogOptions(&options);
+	options.dialogOptionFlags |= kNavAllowMultipleFiles;
+	options.dialogOptionFlags &= ~kNavAllowPreviews;
+	PLstrcpy(options.message, "\pChoose files or folders to fix:");
+	if(NavChooseObject(nil, &reply, &options, eventUPP, nil, nil) == noErr)
 	{
-		if(gCreator != 0 && gType != 0)
-		{
-			err = HGetFInfo(vRefNum, dirID, fName, &fi);
-			if(err) return err;
-			fi.fdType = gType;
-			fi.fdCreator = gCreator;
-			err = HSetFInfo(vRefNum, dirID, fName, &fi);
-
-			if(err)
-			{
-				NumToString(err, errString);
-				ParamText("\pCould't set type/creator for ", fName, "\p err: ", errString);
-				StopAlert(128, nil);
-			}
-		}
-		// else unkown type/creator
-	} else {
-		ParamText("\pCould't determine type/creator for ", fName, "\p", "\p");
-		StopAlert(128, nil);
+		if(reply.validRecord)
+			FixDocList(&reply.selection, nil);
+		NavDisposeReply(&reply);
 	}
-
-	TouchFolder(vRefNum, dirID);
-	return FSClose(fRefNum);
+	if(eventUPP)
+		DisposeNavEventUPP(eventUPP);
 }
+#endif
 
-void main()
+#endif
+
+// Blank or catch-all types, as left by most transfers.
+static Boolean IsGeneric(const ResultRec *rec)
 {
-	MaxApplZone();
-	InitGraf(&qd.thePort);
-	InitFonts();
-	InitWindows();
-	InitMenus();
-	TEInit();
-	InitDialogs(nil);
-	InitCursor();
+	return rec->oldType == 0 || rec->oldType == '????' || rec->oldType == 'BINA'
+		|| rec->oldCreator == 0 || rec->oldCreator == '????';
+}
 
-	FlushEvents(everyEvent, 0);
-	InstallEventHandlers();
-	if(!gHandledByDnD)
-		OpenFileDialog();
-	return;
+// ioFlAttrib and fdFlags bits.
+#define kFileLocked 0x01
+#define kFileIsAlias 0x8000
+
+static void CatalogRec(const CInfoPBRec *pb, ResultRec *rec)
+{
+	memset(rec, 0, sizeof(*rec));
+	// ioDirID comes back as the file number.
+	rec->fileID = pb->hFileInfo.ioDirID;
+	rec->oldType = rec->newType = pb->hFileInfo.ioFlFndrInfo.fdType;
+	rec->oldCreator = rec->newCreator = pb->hFileInfo.ioFlFndrInfo.fdCreator;
+	rec->detector = kDetectNone;
 }
-// TODO: Move to own file.
 
-Boolean isBinHex4()
+short Prefilter(const CInfoPBRec *pb)
 {
-	// FixMe: Magic can be any line in the first 8k of the file.
-	return magicCheck("BinHex 4.0", 10, 34, 'BINA', 'SITx');
+	ResultRec rec;
+
+	CatalogRec(pb, &rec);
+	// An alias's type is its target's; changing it breaks the alias.
+	if(pb->hFileInfo.ioFlFndrInfo.fdFlags & kFileIsAlias)
+		return kPrefilterSkip;
+	if(gBatch.genericOnly && !IsGeneric(&rec))
+		return kPrefilterSkip;
+	// Setting a locked file's type fails with fLckdErr anyway.
+	if(!gBatch.dryRun && (pb->hFileInfo.ioFlAttrib & kFileLocked))
+		return kPrefilterSkip;
+	if(pb->hFileInfo.ioFlLgLen == 0)
+		return kPrefilterName;
+	return kPrefilterSniff;
 }
 
-Boolean isSit15()
+// Only 'fixf' hears about it; the summary and log are for files that
+// were looked at. A locked file may be unlocked by the next run, so its
+// folder mustn't be saved as done.
+void SkipFile(const FSSpec *fss, const CInfoPBRec *pb)
 {
-	short stuffitVersion = 0;
-	if(magicCheck("SIT!", 4, 0, 'SIT!', 'SIT!'))
-	{
-		gType = 0;
-		gCreator = 0;
-		// 0x01 for 1.5.x, 0x02 for 1.6-4.5
-		stuffitVersion = gBuf[14];
-		return (stuffitVersion == 0x01 || stuffitVersion == 0x02) && magicCheck("rLau", 4, 10, 'SIT!', 'SIT!');
-	}
-	return false;
+	ResultRec rec;
+
+	if(!gBatch.dryRun && (pb->hFileInfo.ioFlAttrib & kFileLocked))
+		RescanFailed(fss->vRefNum, fss->parID);
+	CatalogRec(pb, &rec);
+	AddVerdict(fss->name, &rec, noErr);
 }
 
-Boolean isSit5()
+// Whether the detected type/creator should replace the one in rec;
+// false when they're already the same.
+Boolean WantsFix(Boolean found, const SniffRec *sniff, const ResultRec *rec)
 {
-	short stuffitVersion = gBuf[82]; // 0x05
-	return (stuffitVersion == 0x05 && magicCheck("StuffIt (c)1997", 15, 0, 'SITD', 'SIT!'));
+	return found && sniff->creator != 0 && sniff->type != 0 && (!gBatch.genericOnly || IsGeneric(rec))
+		&& (sniff->type != rec->oldType || sniff->creator != rec->oldCreator);
 }
 
-Boolean isBinSit()
+// Summary, results log and 'fixf' verdict for a file that was read and
+// classified. rec->err is set if the new type/creator couldn't be set.
+void FinishFile(const unsigned char *fName, Boolean found, ResultRec *rec, const UnsignedWide *start)
 {
-	short stuffitVersion = 0;
-	if(magicCheck("SIT!", 4, 0 + 128, 'SIT!', 'SIT!'))
+	UnsignedWide end;
+	char name[256];
+	short i;
+
+	if(!found)
+		SummaryAdd(fName, kSummaryUnknown, noErr);
+	else if(rec->err)
+		SummaryAdd(fName, kSummarySetFailed, rec->err);
+	AddVerdict(fName, rec, rec->err);
+	if(gLogRefNum && !gBatch.dryRun)
 	{
-		gType = 0;
-		gCreator = 0;
-		// 0x01 for 1.5.x, 0x02 for 1.6-4.5
-		stuffitVersion = gBuf[14 + 128];
-		return (stuffitVersion == 0x01 || stuffitVersion == 0x02) && magicCheck("rLau", 4, 10 + 128, 'BINA', 'SITx');
+		for(i = 0; i < fName[0]; i++)
+			name[i] = fName[i + 1];
+		name[i] = 0;
+		rec->path = name;
+		Microseconds(&end);
+		rec->micros = end.lo - start->lo;
+		ResultLogAppend(&gLog, rec);
+		rec->path = nil;
 	}
-	return false;
 }
 
-Boolean isDsk4()
-{
-	char magic[] = "\1\0";
-	return  magicCheck(magic, 2, 52, 'dImg', 'dCpy');
-}
-// Disk Copy 6
-Boolean isDsk_1024()
+// Always closes fRefNum. 0 means nothing was opened, for an empty data
+// fork (kPrefilterName).
+OSErr openFile(unsigned char *fName, short fRefNum, short vRefNum, long dirID)
 {
-	return  magicCheck("BD", 2, 0, 'DDim', 'ddsk');
-}
+	OSErr err = noErr;
+	HParamBlockRec pb;
+	Boolean found = false;
+	UnsignedWide start;
+	UInt32 mark = StatsNow();
+	ResultRec rec = {0};
 
-// Very loose check, do last.
-Boolean isCpt()
-{
-	char magic[] = "\1\1";
-	return  magicCheck(magic, 2, 0, 'PACT', 'CPCT');
-}
+	Microseconds(&start);
+	gSniff.count = 0;
+	if(fRefNum)
+	{
+		// One read covers the checks @ 1024 as well.
+		gSniff.count = SNIFF_SIZE;
+		err = FSRead(fRefNum, &gSniff.count, gSniff.buf);
+		StatsStage(kStageRead, mark);
+	}
+	// eofErr == partial read, probably small file, ok to continue.
+	if(err && err != eofErr)
+	{
+		FSClose(fRefNum);
+		return err;
+	}
+	mark = StatsNow();
+	SniffPad(&gSniff);
+	found = SniffFile(&gSniff, fName);
+	StatsStage(kStageSniff, mark);
+	StatsSniff(&gSniff);
 
-Boolean isMar()
-{
-	return  magicCheck("MAR", 3, 0, 'MARf', 'MARc');
-}
+	pb.fileParam.ioNamePtr = fName;
+	pb.fileParam.ioVRefNum = vRefNum;
+	pb.fileParam.ioDirID = dirID;
+	pb.fileParam.ioFDirIndex = 0;
+	pb.fileParam.ioFVersNum = 0;
+	err = PBHGetFInfoSync(&pb);
+	if(err)
+	{
+		if(fRefNum)
+			FSClose(fRefNum);
+		return err;
+	}
+	// ioDirID comes back as the file number.
+	rec.fileID = pb.fileParam.ioDirID;
+	rec.parID = dirID;
+	rec.oldType = rec.newType = pb.fileParam.ioFlFndrInfo.fdType;
+	rec.oldCreator = rec.newCreator = pb.fileParam.ioFlFndrInfo.fdCreator;
+	rec.detector = gSniff.detector;
 
-Boolean isZip()
-{
-	return  magicCheck("PK", 2, 0, 'ZIP ', 'IZip');
-}
+	if(WantsFix(found, &gSniff, &rec))
+	{
+		pb.fileParam.ioFlFndrInfo.fdType = gSniff.type;
+		pb.fileParam.ioFlFndrInfo.fdCreator = gSniff.creator;
+		pb.fileParam.ioDirID = dirID;
+		if(!gBatch.dryRun)
+		{
+			mark = StatsNow();
+			err = PBHSetFInfoSync(&pb);
+			StatsStage(kStageSetInfo, mark);
+		}
 
-short StringLen(const char *str)
-{
-	const char *s;
-	for (s  = str; *s; ++s);
-	return (s-str);
+		if(err)
+		{
+			rec.err = err;
+			RescanFailed(vRefNum, dirID);
+		}
+		else
+		{
+			rec.newType = gSniff.type;
+			rec.newCreator = gSniff.creator;
+		}
+	}
+
+	// Only when something changed, so an incremental rescan (rescan.h)
+	// sees untouched folders as unchanged.
+	if(!gBatch.dryRun && (rec.newType != rec.oldType || rec.newCreator != rec.oldCreator))
+		TouchFolder(vRefNum, dirID);
+	FinishFile(fName, found, &rec, &start);
+	return fRefNum ? FSClose(fRefNum) : noErr;
 }
 
-Boolean StringCompare(const char *lhs, const char *rhs)
+// The same binary runs on every PowerPC; only a G4 gets the AltiVec
+// kernels. 68K code always uses its own.
+static void PickKernels()
 {
-	short i = 0;
-	short len = StringLen(lhs);
-	if(len != StringLen(rhs)) return false;
-	
-	for(i = 0; i < len; i++)
-		if(lhs[i] != rhs[i])
-			return false;
-	return true;
+#if TARGET_CPU_PPC
+	long features;
+
+	if(Gestalt(gestaltPowerPCProcessorFeatures, &features) == noErr
+		&& (features & (1L << gestaltPowerPCHasVectorInstructions)))
+		DetectSetKernels(MatchVector, ClearVector);
+#elif TARGET_CPU_68K
+	DetectSetKernels(MatchLongs, ClearLongs);
+#endif
 }
 
-Boolean magicCheck(char *magic, short len, short offset, OSType type, OSType creator)
+void main()
 {
-	short i;
-	for(i = 0; i < len; i++)
-		if(gBuf[offset+i] != magic[i])
-			return false;
-	gType = type;
-	gCreator = creator;
-	return true;
-}
\ No newline at end of file
+#if FAF_SERVER
+	// Nothing on screen, so no QuickDraw, menus or TextEdit.
+#if !TARGET_API_MAC_CARBON
+	MaxApplZone();
+#endif
+	StatsInit(StatsClock);
+	PickKernels();
+	OpenResultsLog();
+	if(InstallEventHandlers())
+		RunEventLoop();
+	CloseResultsLog();
+#else
+#if !TARGET_API_MAC_CARBON
+	MaxApplZone();
+	InitGraf(&qd.thePort);
+	InitFonts();
+	InitWindows();
+	InitMenus();
+	TEInit();
+	InitDialogs(nil);
+	FlushEvents(everyEvent, 0);
+#endif
+	InitCursor();
+
+	StatsInit(StatsClock);
+	PickKernels();
+	OpenResultsLog();
+	SetUpMenus();
+	if(InstallEventHandlers())
+		RunEventLoop();
+	else
+		OpenFileDialog();	// no Apple Events, nothing can be dropped
+	CloseResultsLog();
+#endif
+	return;
+}
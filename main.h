@@ -5,6 +5,7 @@
 #define __MAIN_H__
 
 #include <stdbool.h>
+#include <string.h>
 #include <Files.h>
 #include <StandardFile.h>
 #include <Events.h>
@@ -13,29 +14,129 @@
 #include <Dialogs.h>
 #include <Types.h>
 #include <Strings.h>
+#include <Timer.h>
+#include <Menus.h>
+#include <Windows.h>
+#include <ToolUtils.h>
+#if !TARGET_CPU_68K
+#include <Navigation.h>
+#endif
+#if !TARGET_API_MAC_CARBON
+#include <Devices.h>
+#include <Fonts.h>
+#include <TextEdit.h>
+#endif
+#include "detect.h"
+#if TARGET_CPU_PPC
+#include "detect_vec.h"
+#elif TARGET_CPU_68K
+#include "detect_68k.h"
+#endif
+#include "results.h"
+#include "summary.h"
+#include "progress.h"
+#include "pipeline.h"
+#include "catsearch.h"
+#include "journal.h"
+#include "rescan.h"
+#include "stats.h"
+#include "weak.h"
 
-#define BUF_SIZE 1024
+// FAF_SERVER builds the faceless variant: no menus or windows, driven
+// entirely by Apple Events.
+#ifndef FAF_SERVER
+#define FAF_SERVER 0
+#endif
 
-// Globals
-Byte gBuf[BUF_SIZE] = {0};
-Boolean gHandledByDnD = false;
+#if FAF_SERVER
+// Failures go back in the 'fixf' reply; there is nothing to draw them in.
+#define SummaryBegin()
+#define SummaryAdd(fName, what, err)
+#define SummaryCancelled(remaining)
+#define SummaryResumed(finished)
+#define SummaryEnd()
+#define ProgressBegin(total)
+#define ProgressAdd(more)
+#define ProgressStep(done) ((void)(done), true)
+#define ProgressRemaining() 0
+#define ProgressEnd()
+#endif
+
+#if !TARGET_API_MAC_CARBON
+// Only the 8.5+ names exist in CarbonLib.
+#define EnableMenuItem EnableItem
+#define DisableMenuItem DisableItem
+#endif
+
+// Menus
+#define kAppleMenu 128
+#define kFileMenu 129
+#define kFileOpen 1
+#define kFileSave 2
+#define kFileClose 3
+#define kFileQuit 5
+
+// Idle time for WaitNextEvent; nothing runs in the background.
+#if FAF_SERVER
+#define kSleepTicks 0x7FFFFFFF	// only woken by Apple Events
+#else
+#define kSleepTicks 60
+#endif
+
+// Scripting: 'fixf' takes a list of aliases (files or folders) and
+// optional Boolean dry run, recursive, generic-only and catalog search
+// parameters; catalog search implies generic-only. The reply is a list
+// of verdict records, one per file.
+#define kFAFEventClass 'FAF '
+#define kFAFFixFiles 'fixf'
+#define keyFAFDryRun 'dry '
+#define keyFAFRecursive 'recu'
+#define keyFAFGenericOnly 'gene'
+#define keyFAFCatSearch 'csch'
+#define keyFAFIncremental 'incr'
+#define keyFAFName 'pnam'
+#define keyFAFType 'ftyp'
+#define keyFAFCreator 'fcrt'
+#define keyFAFDetector 'dtct'
+// 'stat', in FAF_STATS builds, writes the counters to Fix-a-Fork
+// Stats.txt next to the app.
+#define kFAFDumpStats 'stat'
+
+// How a batch treats its items. The app always uses the defaults;
+// 'fixf' sets them per event.
+typedef struct {
+	Boolean dryRun;			// report only, change nothing
+	Boolean recursive;		// walk into subfolders
+	Boolean genericOnly;	// only fix blank, ????, or BINA files
+	Boolean catSearch;		// search whole volumes instead of walking them; implies genericOnly
+	Boolean incremental;	// skip folders unchanged since the last run (rescan.h)
+	AEDescList *verdicts;	// 'fixf' reply list, or nil
+} BatchOptions;
+
+extern BatchOptions gBatch;
 
 OSErr openFile(unsigned char *fName, short fRefNum, short vRefNum, long dirID);
+void OpenFileDialog();
+OSErr FixDocList(AEDescList *docList, AEDescList *results);
+void AddVerdict(const unsigned char *fName, const ResultRec *rec, OSErr err);
+OSErr TouchFolder(short vRefNum, long parID);
+// Names a volume across restarts, where a vRefNum won't do.
+UInt32 VolumeDate(short vRefNum);
+Boolean WantsFix(Boolean found, const SniffRec *sniff, const ResultRec *rec);
+// What a file needs, decided from its catalog record alone, before
+// anything is opened.
+enum {
+	kPrefilterSkip,		// it can't change; leave it closed
+	kPrefilterName,		// empty data fork, only the name can match
+	kPrefilterSniff		// read the header
+};
+short Prefilter(const CInfoPBRec *pb);
+// The unchanged verdict of a skipped file.
+void SkipFile(const FSSpec *fss, const CInfoPBRec *pb);
+void FinishFile(const unsigned char *fName, Boolean found, ResultRec *rec, const UnsignedWide *start);
+void AdjustMenus();
 pascal OSErr DoOpenDoc(AppleEvent *event, AppleEvent *reply, long handlerRefcon);
 
-// checks
-Boolean StringCompare(const char *lhs, const char *rhs);
-short StringLen(const char *str);
-Boolean magicCheck(char *magic, short len, short offset, OSType type, OSType creator);
-Boolean isBinHex4();
-Boolean isSit5();
-Boolean isSit15();
-Boolean isBinSit();
-Boolean isDsk4();
-Boolean isZip();
-Boolean isMar();
-Boolean isCpt();
-Boolean isDsk_1024();
 //Boolean CheckFileExt(const char *ext);
 // short strlen(const char *str);
 #endif
\ No newline at end of file
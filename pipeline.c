@@ -0,0 +1,657 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+
+#include "main.h"
+#include "workers.h"
+#include "weak.h"
+#include <Threads.h>
+
+// Files in flight at once. The queues can always hold every job, so a
+// stage never waits to hand one on; the walk waits for the writer to
+// give one back instead.
+#define kPipeJobs 16
+#define kPipeStack (16 * 1024)
+#define kWalkStack (32 * 1024)	// CatSearchGeneric's matches live on it
+#define kPipeStages 4
+#define kPipeCheckpoints 64
+#define kWalkGrow 32		// folder frames added at a time
+
+typedef struct {
+	FSSpec fss;
+	CInfoPBRec cat;		// from the walk, written back by the writer
+	long item;			// doc list index if dropped itself, else 0
+	SniffRec sniff;
+	Boolean found;
+	OSErr err;
+	UnsignedWide start;
+	UInt32 mark;		// stage start, for stats.h
+	UInt32 seq;			// order queued in
+	Boolean busy;		// out of freeQ
+} FileJob;
+
+typedef struct {
+	FileJob *slot[kPipeJobs];
+	short head;
+	short count;
+} JobQueue;
+
+// A folder or dropped item the walk has finished with. It goes in the
+// journal once every job queued up to seq has been written.
+typedef struct {
+	long item;			// doc list index, or 0 for a folder
+	short vRefNum;
+	long dirID;
+	UInt32 seq;
+} Checkpoint;
+
+// A folder being walked. The walk keeps these on the heap rather than
+// recursing, so a deep tree can't run off the end of a thread stack.
+typedef struct {
+	short vRefNum;
+	long dirID;
+	long next;			// catalog index, or RescanNextChild cursor
+	Boolean known;		// unchanged since the last run (rescan.h)
+} WalkFrame;
+
+typedef struct {
+	FileJob *jobs;
+	JobQueue freeQ, readQ, sniffQ, writeQ;
+	// Set by each stage as it finishes.
+	Boolean walked, read, sniffed, written;
+	Boolean cancelled;
+	Boolean workers;	// classify on MP tasks
+	long done;
+	AEDescList *docList;
+	long itemsInList;
+	OSErr *itemErr;
+	short touchVRefNum;
+	long touchDirID;
+	UInt32 seq;
+	WalkFrame **frames;
+	long depth;
+	Boolean lost;		// a folder couldn't be walked, so no checkpoints
+	Checkpoint pending[kPipeCheckpoints];
+	short pendingHead;
+	short pendingCount;
+} PipeState;
+
+#if WEAK_IMPORTS
+WeakProc(NewThread);
+WeakProc(DisposeThread);
+WeakProc(YieldToAnyThread);
+
+static const WeakImportRec kThreadImports[] = {
+	WeakRec(NewThread),
+	WeakRec(DisposeThread),
+	WeakRec(YieldToAnyThread)
+};
+
+#define NewThread (*gWeakNewThread)
+#define DisposeThread (*gWeakDisposeThread)
+#define YieldToAnyThread (*gWeakYieldToAnyThread)
+#endif
+
+static PipeState gPipe;
+static ThreadEntryUPP gStageUPP[kPipeStages];
+
+// Every File Manager call goes async; the thread yields until it's done.
+static OSErr WaitIO(volatile OSErr *ioResult)
+{
+	while(*ioResult > 0)
+		YieldToAnyThread();
+	return *ioResult;
+}
+
+static void Put(JobQueue *q, FileJob *job)
+{
+	q->slot[(q->head + q->count++) % kPipeJobs] = job;
+}
+
+// The next job, waiting for one if need be. nil once *finished is set
+// and the queue is empty.
+static FileJob *Take(JobQueue *q, Boolean *finished)
+{
+	FileJob *job;
+
+	while(!q->count)
+	{
+		if(*finished)
+			return nil;
+		YieldToAnyThread();
+	}
+	job = q->slot[q->head];
+	q->head = (q->head + 1) % kPipeJobs;
+	q->count--;
+	return job;
+}
+
+// Journals the checkpoints nothing is still in flight for. all is for
+// the end, once every job is back.
+static void JournalPending(Boolean all)
+{
+	Checkpoint *cp;
+	UInt32 oldest = 0;
+	short i;
+
+	if(!all)
+		for(i = 0; i < kPipeJobs; i++)
+			if(gPipe.jobs[i].busy && (!oldest || gPipe.jobs[i].seq < oldest))
+				oldest = gPipe.jobs[i].seq;
+	while(gPipe.pendingCount)
+	{
+		cp = &gPipe.pending[gPipe.pendingHead];
+		if(oldest && oldest <= cp->seq)
+			return;
+		if(cp->item)
+			JournalItem(cp->item);
+		else
+			JournalDir(cp->vRefNum, cp->dirID);
+		gPipe.pendingHead = (gPipe.pendingHead + 1) % kPipeCheckpoints;
+		gPipe.pendingCount--;
+	}
+}
+
+// If too much is waiting on one slow file, the checkpoint is dropped;
+// a resumed run just does that part again.
+static void AddCheckpoint(long item, short vRefNum, long dirID)
+{
+	Checkpoint *cp;
+
+	if(gPipe.cancelled || gPipe.lost)
+		return;
+	JournalPending(false);
+	if(gPipe.pendingCount == kPipeCheckpoints)
+		return;
+	cp = &gPipe.pending[(gPipe.pendingHead + gPipe.pendingCount++) % kPipeCheckpoints];
+	cp->item = item;
+	cp->vRefNum = vRefNum;
+	cp->dirID = dirID;
+	cp->seq = gPipe.seq;
+}
+
+// Queues a folder for Walk.
+static Boolean PushFolder(short vRefNum, long dirID, Boolean known)
+{
+	WalkFrame *f;
+
+	if(gPipe.depth % kWalkGrow == 0)
+	{
+		SetHandleSize((Handle)gPipe.frames, (gPipe.depth + kWalkGrow) * sizeof(WalkFrame));
+		if(MemError())
+			return false;
+	}
+	f = &(*gPipe.frames)[gPipe.depth++];
+	f->vRefNum = vRefNum;
+	f->dirID = dirID;
+	f->next = known ? 0 : 1;
+	f->known = known;
+	return true;
+}
+
+// pb is fss's catalog info. Files are queued for reading with it, so
+// the writer never has to look them up again.
+static void Enqueue(FSSpec *fss, CInfoPBRec *pb, long item)
+{
+	FileJob *job;
+	short filter;
+	Boolean known;
+
+	if(gPipe.cancelled)
+		return;
+	if(pb->hFileInfo.ioFlAttrib & ioDirMask)
+	{
+		if((item || gBatch.recursive) && !JournalDirDone(fss->vRefNum, pb->dirInfo.ioDrDirID))
+		{
+			known = RescanFolder(fss->vRefNum, pb);
+			if(!known)
+				ProgressAdd(pb->dirInfo.ioDrNmFls);
+			if(!PushFolder(fss->vRefNum, pb->dirInfo.ioDrDirID, known))
+			{
+				SummaryAdd(fss->name, kSummaryOpenFailed, memFullErr);
+				AddVerdict(fss->name, nil, memFullErr);
+				gPipe.lost = true;
+			}
+		}
+		gPipe.done++;
+		return;
+	}
+	filter = Prefilter(pb);
+	if(filter == kPrefilterSkip)
+	{
+		SkipFile(fss, pb);
+		gPipe.done++;
+		return;
+	}
+	job = Take(&gPipe.freeQ, &gPipe.cancelled);
+	if(!job)
+		return;
+	job->fss = *fss;
+	job->cat = *pb;
+	job->cat.hFileInfo.ioNamePtr = job->fss.name;
+	job->item = item;
+	job->err = noErr;
+	job->seq = ++gPipe.seq;
+	job->busy = true;
+	if(filter == kPrefilterName)
+	{
+		// Nothing to read, straight to the sniffer.
+		Microseconds(&job->start);
+		job->sniff.count = 0;
+		Put(&gPipe.sniffQ, job);
+	}
+	else
+		Put(&gPipe.readQ, job);
+}
+
+// Walks every folder PushFolder queued, depth first. A folder goes to
+// the journal once everything in it has been queued.
+static void Walk()
+{
+	WalkFrame f;
+	CInfoPBRec pb;
+	FSSpec fss;
+	long subID;
+	Boolean more;
+	OSErr err;
+
+	while(gPipe.depth && !gPipe.cancelled)
+	{
+		f = (*gPipe.frames)[gPipe.depth - 1];
+		fss.vRefNum = f.vRefNum;
+		fss.parID = f.dirID;
+		fss.name[0] = 0;
+		pb.hFileInfo.ioCompletion = nil;
+		pb.hFileInfo.ioNamePtr = fss.name;
+		pb.hFileInfo.ioVRefNum = f.vRefNum;
+		if(f.known)
+		{
+			// Only the subfolders it had last run, by dirID.
+			more = RescanNextChild(f.vRefNum, f.dirID, &f.next, &subID);
+			err = fnfErr;
+			if(more)
+			{
+				pb.dirInfo.ioDrDirID = subID;
+				pb.dirInfo.ioFDirIndex = -1;
+				PBGetCatInfoAsync(&pb);
+				err = WaitIO(&pb.dirInfo.ioResult);
+				// Gone, or moved out since.
+				if(!err && pb.dirInfo.ioDrParID != f.dirID)
+					err = fnfErr;
+				if(!err)
+					ProgressAdd(1);
+			}
+		}
+		else
+		{
+			pb.hFileInfo.ioDirID = f.dirID;
+			pb.hFileInfo.ioFDirIndex = f.next++;
+			PBGetCatInfoAsync(&pb);
+			err = WaitIO(&pb.hFileInfo.ioResult);
+			more = !err;	// fnfErr past the last item
+		}
+		(*gPipe.frames)[gPipe.depth - 1].next = f.next;
+		if(!err)
+			Enqueue(&fss, &pb, 0);
+		else if(!more)
+		{
+			gPipe.depth--;
+			AddCheckpoint(0, f.vRefNum, f.dirID);
+		}
+	}
+	gPipe.depth = 0;
+}
+
+static Boolean SearchIdle(void *refCon)
+{
+	YieldToAnyThread();
+	return !gPipe.cancelled;
+}
+
+// A whole volume by catalog search rather than a walk (catsearch.h).
+static OSErr SearchVolume(short vRefNum)
+{
+	Handle found;
+	CInfoPBRec pb;
+	FSSpec fss;
+	long offset = 0, count = 0;
+	OSErr err;
+
+	// The search starts over whenever the catalog changes, so let the
+	// writer finish with everything before it.
+	while(gPipe.freeQ.count < kPipeJobs)
+		YieldToAnyThread();
+	found = NewHandle(0);
+	if(!found)
+		return memFullErr;
+	err = CatSearchGeneric(vRefNum, found, &count, SearchIdle, nil);
+	if(!err)
+		ProgressAdd(count);
+	while(!err && !gPipe.cancelled && CatSearchNext(found, &offset, vRefNum, &fss))
+	{
+		pb.hFileInfo.ioCompletion = nil;
+		pb.hFileInfo.ioNamePtr = fss.name;
+		pb.hFileInfo.ioVRefNum = fss.vRefNum;
+		pb.hFileInfo.ioDirID = fss.parID;
+		pb.hFileInfo.ioFDirIndex = 0;
+		PBGetCatInfoAsync(&pb);
+		if(WaitIO(&pb.hFileInfo.ioResult) == noErr)
+			Enqueue(&fss, &pb, 0);
+		else
+			gPipe.done++;	// gone since the search
+	}
+	DisposeHandle(found);
+	gPipe.done++;
+	return err;
+}
+
+static pascal voidPtr WalkStage(void *param)
+{
+	CInfoPBRec pb;
+	FSSpec fss;
+	OSErr err;
+	long index;
+	Size actualSize;
+	AEKeyword keywd;
+	DescType returnedType;
+
+	for(index = 1; index <= gPipe.itemsInList; index++)
+	{
+		if(gPipe.cancelled)
+		{
+			gPipe.itemErr[index - 1] = userCanceledErr;
+			continue;
+		}
+		if(JournalItemDone(index))
+		{
+			gPipe.done++;
+			continue;
+		}
+		err = AEGetNthPtr(gPipe.docList, index, typeFSS, &keywd, &returnedType, (Ptr)&fss, sizeof(fss), &actualSize);
+		if(err)
+		{
+			gPipe.itemErr[index - 1] = err;
+			continue;
+		}
+		pb.hFileInfo.ioCompletion = nil;
+		pb.hFileInfo.ioNamePtr = fss.name;
+		pb.hFileInfo.ioVRefNum = fss.vRefNum;
+		pb.hFileInfo.ioDirID = fss.parID;
+		pb.hFileInfo.ioFDirIndex = 0;
+		PBGetCatInfoAsync(&pb);
+		err = WaitIO(&pb.hFileInfo.ioResult);
+		if(err)
+		{
+			gPipe.itemErr[index - 1] = err;
+			SummaryAdd(fss.name, kSummaryOpenFailed, err);
+			AddVerdict(fss.name, nil, err);
+			gPipe.done++;
+			continue;
+		}
+		if(gBatch.catSearch && (pb.hFileInfo.ioFlAttrib & ioDirMask) && pb.dirInfo.ioDrDirID == fsRtDirID
+			&& CatSearchAvailable(fss.vRefNum))
+			gPipe.itemErr[index - 1] = SearchVolume(fss.vRefNum);
+		else
+		{
+			Enqueue(&fss, &pb, index);
+			Walk();
+		}
+		if(gPipe.cancelled)
+			gPipe.itemErr[index - 1] = userCanceledErr;
+		else
+			AddCheckpoint(index, 0, 0);
+	}
+	gPipe.walked = true;
+	return nil;
+}
+
+static pascal voidPtr ReadStage(void *param)
+{
+	FileJob *job;
+	HParamBlockRec hpb;
+	ParamBlockRec pb;
+
+	while((job = Take(&gPipe.readQ, &gPipe.walked)) != nil)
+	{
+		Microseconds(&job->start);
+		job->mark = StatsNow();
+		hpb.ioParam.ioCompletion = nil;
+		hpb.ioParam.ioNamePtr = job->fss.name;
+		hpb.ioParam.ioVRefNum = job->fss.vRefNum;
+		hpb.ioParam.ioVersNum = 0;
+		hpb.ioParam.ioPermssn = fsRdPerm;
+		hpb.ioParam.ioMisc = nil;
+		hpb.fileParam.ioDirID = job->fss.parID;
+		PBHOpenDFAsync(&hpb);
+		job->err = WaitIO(&hpb.ioParam.ioResult);
+		if(!job->err)
+		{
+			// One read covers the checks @ 1024 as well.
+			pb.ioParam.ioCompletion = nil;
+			pb.ioParam.ioRefNum = hpb.ioParam.ioRefNum;
+			pb.ioParam.ioBuffer = (Ptr)job->sniff.buf;
+			pb.ioParam.ioReqCount = SNIFF_SIZE;
+			pb.ioParam.ioPosMode = fsFromStart;
+			pb.ioParam.ioPosOffset = 0;
+			PBReadAsync(&pb);
+			job->err = WaitIO(&pb.ioParam.ioResult);
+			job->sniff.count = pb.ioParam.ioActCount;
+			// eofErr == partial read, probably small file, ok to continue.
+			if(job->err == eofErr)
+				job->err = noErr;
+			pb.ioParam.ioCompletion = nil;
+			pb.ioParam.ioRefNum = hpb.ioParam.ioRefNum;
+			PBCloseAsync(&pb);
+			WaitIO(&pb.ioParam.ioResult);
+		}
+		StatsStage(kStageRead, job->mark);
+		Put(job->err ? &gPipe.writeQ : &gPipe.sniffQ, job);
+	}
+	gPipe.read = true;
+	return nil;
+}
+
+// Hands each job to the MP workers and picks up whatever they've
+// finished, yielding in between. Jobs may come back out of order.
+static void SniffOnWorkers()
+{
+	FileJob *job;
+	Boolean found;
+	long pending = 0;
+
+	for(;;)
+	{
+		while(gPipe.sniffQ.count)
+		{
+			job = Take(&gPipe.sniffQ, &gPipe.read);
+			SniffPad(&job->sniff);
+			job->mark = StatsNow();
+			WorkersPost(&job->sniff, job->fss.name, job);
+			pending++;
+		}
+		while((job = WorkersTake(&found)) != nil)
+		{
+			job->found = found;
+			// Includes the time queued for a worker.
+			StatsStage(kStageSniff, job->mark);
+			Put(&gPipe.writeQ, job);
+			pending--;
+		}
+		if(!pending && gPipe.read && !gPipe.sniffQ.count)
+			return;
+		YieldToAnyThread();
+	}
+}
+
+static pascal voidPtr SniffStage(void *param)
+{
+	FileJob *job;
+
+	if(gPipe.workers)
+		SniffOnWorkers();
+	else
+	{
+		while((job = Take(&gPipe.sniffQ, &gPipe.read)) != nil)
+		{
+			job->mark = StatsNow();
+			SniffPad(&job->sniff);
+			job->found = SniffFile(&job->sniff, job->fss.name);
+			StatsStage(kStageSniff, job->mark);
+			Put(&gPipe.writeQ, job);
+			// No I/O here to yield on.
+			YieldToAnyThread();
+		}
+	}
+	gPipe.sniffed = true;
+	return nil;
+}
+
+// A folder is touched once, when the writer moves on from it, rather
+// than after every file in it. dirID 0 flushes the last one.
+static void TouchLater(short vRefNum, long dirID)
+{
+	if(vRefNum == gPipe.touchVRefNum && dirID == gPipe.touchDirID)
+		return;
+	if(gPipe.touchDirID)
+		TouchFolder(gPipe.touchVRefNum, gPipe.touchDirID);
+	gPipe.touchVRefNum = vRefNum;
+	gPipe.touchDirID = dirID;
+}
+
+static pascal voidPtr WriteStage(void *param)
+{
+	FileJob *job;
+	CInfoPBRec *pb;
+	ResultRec rec;
+
+	while((job = Take(&gPipe.writeQ, &gPipe.sniffed)) != nil)
+	{
+		if(job->err)
+		{
+			SummaryAdd(job->fss.name, kSummaryOpenFailed, job->err);
+			AddVerdict(job->fss.name, nil, job->err);
+		}
+		else
+		{
+			pb = &job->cat;
+			memset(&rec, 0, sizeof(rec));
+			// ioDirID came back from the walk as the file number.
+			rec.fileID = pb->hFileInfo.ioDirID;
+			rec.parID = job->fss.parID;
+			rec.oldType = rec.newType = pb->hFileInfo.ioFlFndrInfo.fdType;
+			rec.oldCreator = rec.newCreator = pb->hFileInfo.ioFlFndrInfo.fdCreator;
+			rec.detector = job->sniff.detector;
+			StatsSniff(&job->sniff);
+			if(WantsFix(job->found, &job->sniff, &rec))
+			{
+				if(!gBatch.dryRun)
+				{
+					pb->hFileInfo.ioCompletion = nil;
+					pb->hFileInfo.ioVRefNum = job->fss.vRefNum;
+					pb->hFileInfo.ioDirID = job->fss.parID;
+					pb->hFileInfo.ioFlFndrInfo.fdType = job->sniff.type;
+					pb->hFileInfo.ioFlFndrInfo.fdCreator = job->sniff.creator;
+					job->mark = StatsNow();
+					PBSetCatInfoAsync(pb);
+					rec.err = WaitIO(&pb->hFileInfo.ioResult);
+					StatsStage(kStageSetInfo, job->mark);
+				}
+				if(!rec.err)
+				{
+					rec.newType = job->sniff.type;
+					rec.newCreator = job->sniff.creator;
+				}
+			}
+			if(!gBatch.dryRun && (rec.newType != rec.oldType || rec.newCreator != rec.oldCreator))
+				TouchLater(job->fss.vRefNum, job->fss.parID);
+			FinishFile(job->fss.name, job->found, &rec, &job->start);
+			job->err = rec.err;
+		}
+		if(job->err)
+			RescanFailed(job->fss.vRefNum, job->fss.parID);
+		if(job->item)
+			gPipe.itemErr[job->item - 1] = job->err;
+		gPipe.done++;
+		job->busy = false;
+		Put(&gPipe.freeQ, job);
+		JournalPending(false);
+	}
+	TouchLater(0, 0);
+	JournalPending(true);
+	gPipe.written = true;
+	return nil;
+}
+
+Boolean PipelineAvailable()
+{
+	long attr;
+
+	if(Gestalt(gestaltThreadMgrAttr, &attr) != noErr || !(attr & (1L << gestaltThreadMgrPresent)))
+		return false;
+#if WEAK_IMPORTS
+	// PowerPC code also needs the Thread Manager's shared library.
+	if(!(attr & (1L << gestaltThreadsLibraryPresent)))
+		return false;
+	if(!gWeakYieldToAnyThread && !WeakImport("\pThreadsLib", kThreadImports, sizeof(kThreadImports) / sizeof(kThreadImports[0])))
+		return false;
+#endif
+	return true;
+}
+
+OSErr PipelineRun(AEDescList *docList, long itemsInList, OSErr *itemErr)
+{
+	ThreadID threads[kPipeStages];
+	OSErr err = noErr;
+	short i, started;
+
+	if(!gStageUPP[0])
+	{
+		gStageUPP[0] = NewThreadEntryUPP(WalkStage);
+		gStageUPP[1] = NewThreadEntryUPP(ReadStage);
+		gStageUPP[2] = NewThreadEntryUPP(SniffStage);
+		gStageUPP[3] = NewThreadEntryUPP(WriteStage);
+	}
+	memset(&gPipe, 0, sizeof(gPipe));
+	gPipe.jobs = (FileJob *)NewPtr(kPipeJobs * sizeof(FileJob));
+	gPipe.frames = (WalkFrame **)NewHandle(0);
+	if(!gPipe.jobs || !gPipe.frames)
+	{
+		if(gPipe.jobs)
+			DisposePtr((Ptr)gPipe.jobs);
+		return memFullErr;
+	}
+	for(i = 0; i < kPipeJobs; i++)
+		Put(&gPipe.freeQ, &gPipe.jobs[i]);
+	gPipe.docList = docList;
+	gPipe.itemsInList = itemsInList;
+	gPipe.itemErr = itemErr;
+	gPipe.workers = WorkersStart();
+
+	// Nothing runs until the first yield, so a failure here leaves
+	// nothing half done.
+	for(started = 0; started < kPipeStages; started++)
+	{
+		err = NewThread(kCooperativeThread, gStageUPP[started], nil, started ? kPipeStack : kWalkStack,
+			kCreateIfNeeded, nil, &threads[started]);
+		if(err)
+			break;
+	}
+	if(err)
+	{
+		for(i = 0; i < started; i++)
+			DisposeThread(threads[i], nil, false);
+		DisposePtr((Ptr)gPipe.jobs);
+		DisposeHandle((Handle)gPipe.frames);
+		return err;
+	}
+
+	while(!gPipe.written)
+	{
+		YieldToAnyThread();
+		if(!gPipe.cancelled && !ProgressStep(gPipe.done))
+			gPipe.cancelled = true;
+	}
+	DisposePtr((Ptr)gPipe.jobs);
+	DisposeHandle((Handle)gPipe.frames);
+	return gPipe.cancelled ? userCanceledErr : noErr;
+}
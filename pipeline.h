@@ -0,0 +1,22 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+#ifndef __PIPELINE_H__
+#define __PIPELINE_H__
+
+// A batch as Thread Manager threads, one per stage, so that one stage
+// waiting on the disk lets the others get on:
+//
+//	walk the catalog -> read headers -> classify -> write the catalog
+
+#include <MacTypes.h>
+#include <AppleEvents.h>
+
+Boolean PipelineAvailable();
+// Fixes every item in docList, setting itemErr[i] for item i + 1 as the
+// serial path does. Returns userCanceledErr after Cmd-period, or the
+// error that kept the threads from starting, in which case nothing has
+// been done.
+OSErr PipelineRun(AEDescList *docList, long itemsInList, OSErr *itemErr);
+
+#endif
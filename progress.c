@@ -0,0 +1,180 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+
+#include "progress.h"
+#include "summary.h"
+#include <Events.h>
+#include <Quickdraw.h>
+#include <TextUtils.h>
+#include <ToolUtils.h>
+#include <Windows.h>
+#if TARGET_API_MAC_CARBON
+#include <CarbonEvents.h>
+#endif
+
+#if TARGET_API_MAC_CARBON
+#define WindowBounds(w, r) GetWindowPortBounds(w, r)
+#define SetWindowPort(w) SetPortWindowPort(w)
+#else
+#define WindowBounds(w, r) (*(r) = (w)->portRect)
+#define SetWindowPort(w) SetPort(w)
+#endif
+
+WindowPtr gProgressWindow = nil;
+long gProgressTotal = 0;
+long gProgressDone = 0;
+UInt32 gProgressStart = 0;
+UInt32 gProgressLastYield = 0;
+Boolean gProgressCancelled = false;
+
+static void AppendString(Str255 s, const unsigned char *p)
+{
+	short i;
+	for(i = 1; i <= p[0] && s[0] < 255; i++)
+		s[++s[0]] = p[i];
+}
+
+static void AppendNumber(Str255 s, long n)
+{
+	Str255 num;
+	NumToString(n, num);
+	AppendString(s, num);
+}
+
+static void DrawProgress()
+{
+	UInt32 ticks = TickCount() - gProgressStart;
+	long rate, left;
+	Rect r, bar;
+	Str255 line;
+
+	SetWindowPort(gProgressWindow);
+	WindowBounds(gProgressWindow, &r);
+	EraseRect(&r);
+
+	line[0] = 0;
+	AppendString(line, "\pFixing ");
+	AppendNumber(line, gProgressDone);
+	AppendString(line, "\p of ");
+	AppendNumber(line, gProgressTotal);
+	AppendString(line, "\p files");
+	MoveTo(12, 20);
+	DrawString(line);
+
+	line[0] = 0;
+	rate = ticks ? gProgressDone * 60 / ticks : 0;
+	AppendNumber(line, rate);
+	AppendString(line, "\p files/s");
+	if(rate > 0 && gProgressDone < gProgressTotal)
+	{
+		left = (gProgressTotal - gProgressDone) / rate;
+		AppendString(line, "\p, about ");
+		if(left >= 120)
+		{
+			AppendNumber(line, left / 60);
+			AppendString(line, "\p min left");
+		}
+		else
+		{
+			AppendNumber(line, left);
+			AppendString(line, "\p s left");
+		}
+	}
+	MoveTo(12, 38);
+	DrawString(line);
+
+	SetRect(&bar, 12, 48, r.right - 12, 60);
+	FrameRect(&bar);
+	InsetRect(&bar, 1, 1);
+	if(gProgressTotal > 0)
+		bar.right = bar.left + (long)(bar.right - bar.left) * gProgressDone / gProgressTotal;
+	PaintRect(&bar);
+
+	MoveTo(12, 78);
+	DrawString("\pPress \021-period to stop.");
+#if TARGET_API_MAC_CARBON
+	QDFlushPortBuffer(GetWindowPort(gProgressWindow), nil);
+#endif
+}
+
+static void CreateProgressWindow()
+{
+	Rect bounds = { 100, 100, 190, 440 };
+
+#if TARGET_API_MAC_CARBON
+	CreateNewWindow(kMovableModalWindowClass, kWindowStandardHandlerAttribute, &bounds, &gProgressWindow);
+	SetWTitle(gProgressWindow, "\pFix-a-Fork");
+	ShowWindow(gProgressWindow);
+#else
+	gProgressWindow = NewCWindow(nil, &bounds, "\pFix-a-Fork", true, movableDBoxProc, (WindowPtr)-1, false, 0);
+#endif
+}
+
+void ProgressBegin(long total)
+{
+	gProgressTotal = total;
+	gProgressDone = 0;
+	gProgressStart = gProgressLastYield = TickCount();
+	gProgressCancelled = false;
+}
+
+void ProgressAdd(long more)
+{
+	gProgressTotal += more;
+}
+
+long ProgressRemaining()
+{
+	return gProgressTotal - gProgressDone;
+}
+
+Boolean ProgressStep(long done)
+{
+	EventRecord event;
+	WindowPtr window;
+	UInt32 now = TickCount();
+
+	gProgressDone = done;
+	if(gProgressCancelled)
+		return false;
+	if(now - gProgressLastYield < kSliceTicks)
+		return true;
+	gProgressLastYield = now;
+
+	if(!gProgressWindow && now - gProgressStart >= kShowTicks)
+		CreateProgressWindow();
+	if(gProgressWindow)
+		DrawProgress();
+
+	// Give everyone else a turn. Apple Events stay queued until the
+	// batch is over.
+	while(WaitNextEvent(everyEvent & ~highLevelEventMask, &event, 0, nil))
+	{
+		if(event.what == keyDown && (event.modifiers & cmdKey) && (event.message & charCodeMask) == '.')
+		{
+			gProgressCancelled = true;
+			continue;
+		}
+#if !TARGET_API_MAC_CARBON
+		if(event.what == updateEvt && (WindowPtr)event.message == gProgressWindow)
+		{
+			BeginUpdate(gProgressWindow);
+			DrawProgress();
+			EndUpdate(gProgressWindow);
+		}
+		else if(event.what == mouseDown && FindWindow(event.where, &window) == inDrag && window == gProgressWindow)
+			DragWindow(gProgressWindow, event.where, &qd.screenBits.bounds);
+		else
+			SummaryEvent(&event);
+#endif
+	}
+	return !gProgressCancelled;
+}
+
+void ProgressEnd()
+{
+	if(gProgressWindow)
+		DisposeWindow(gProgressWindow);
+	gProgressWindow = nil;
+}
@@ -0,0 +1,26 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+#ifndef __PROGRESS_H__
+#define __PROGRESS_H__
+
+// Progress window for long batches. The batch calls ProgressStep after
+// each file; every kSliceTicks it gets the window redrawn and the rest
+// of the system a turn through WaitNextEvent, and learns whether the
+// user pressed Cmd-period. The window only appears once a batch has run
+// for kShowTicks, so single drops never flash it.
+
+#include <MacTypes.h>
+
+#define kSliceTicks 6	// 0.1s of work between yields
+#define kShowTicks 30
+
+void ProgressBegin(long total);
+// More work found along the way, e.g. a folder's contents.
+void ProgressAdd(long more);
+long ProgressRemaining();
+// done files so far; returns false once the user has cancelled.
+Boolean ProgressStep(long done);
+void ProgressEnd();
+
+#endif
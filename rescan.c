@@ -0,0 +1,253 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+
+#include "main.h"
+#include "rescan.h"
+#include <stdlib.h>
+
+// The file is a header record then folder records, sorted by volume,
+// parent and dirID, so a folder's subfolders sit next to each other.
+#define kRescanMagic 'FAFr'	// header: parID = options
+#define kRescanBuf 128			// records written at once
+
+typedef struct {
+	UInt32 date;	// volume creation date
+	UInt32 parID;
+	UInt32 dirID;
+	UInt32 modDate;
+	UInt32 valence;
+} FolderRec;
+
+static Boolean gRescanning = false;
+static Ptr gOldBuf = nil;
+static FolderRec *gOld = nil;	// last run's index
+static long gNumOld = 0;
+static Handle gNew = nil;		// this run's folders, in walk order
+static long gNumNew = 0;
+static Boolean gNewFailed = false;
+
+static UInt32 Options()
+{
+	return gBatch.genericOnly | gBatch.catSearch << 1;
+}
+
+static int CompareFolders(const void *a, const void *b)
+{
+	const FolderRec *x = a, *y = b;
+
+	if(x->date != y->date)
+		return x->date < y->date ? -1 : 1;
+	if(x->parID != y->parID)
+		return x->parID < y->parID ? -1 : 1;
+	return x->dirID < y->dirID ? -1 : x->dirID > y->dirID;
+}
+
+static void Forget()
+{
+	if(gOldBuf)
+		DisposePtr(gOldBuf);
+	if(gNew)
+		DisposeHandle(gNew);
+	gOldBuf = nil;
+	gOld = nil;
+	gNumOld = 0;
+	gNew = nil;
+	gNumNew = 0;
+	gNewFailed = false;
+	gRescanning = false;
+}
+
+static void Load()
+{
+	short refNum;
+	long eof = 0, count;
+
+	if(HOpen(0, 0, "\pFix-a-Fork Index", fsRdPerm, &refNum))
+		return;
+	GetEOF(refNum, &eof);
+	count = eof - eof % sizeof(FolderRec);
+	if(count >= (long)sizeof(FolderRec) && (gOldBuf = NewPtr(count)) != nil)
+	{
+		gOld = (FolderRec *)gOldBuf;
+		if(FSRead(refNum, &count, gOldBuf) || gOld->date != kRescanMagic || gOld->parID != Options())
+			count = sizeof(FolderRec);
+		gNumOld = count / sizeof(FolderRec) - 1;
+		gOld++;
+		qsort(gOld, gNumOld, sizeof(FolderRec), CompareFolders);
+	}
+	FSClose(refNum);
+}
+
+void RescanBegin()
+{
+	Forget();
+	if(!gBatch.incremental || !gBatch.recursive)
+		return;
+	gNew = NewHandle(0);
+	if(!gNew)
+		return;
+	gRescanning = true;
+	Load();
+}
+
+// First record at or after (date, parID, dirID).
+static long LowerBound(UInt32 date, UInt32 parID, UInt32 dirID)
+{
+	FolderRec key;
+	long lo = 0, hi = gNumOld, mid;
+
+	key.date = date;
+	key.parID = parID;
+	key.dirID = dirID;
+	while(lo < hi)
+	{
+		mid = (lo + hi) / 2;
+		if(CompareFolders(&gOld[mid], &key) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+Boolean RescanFolder(short vRefNum, const CInfoPBRec *pb)
+{
+	FolderRec rec;
+	long i;
+
+	if(!gRescanning)
+		return false;
+	rec.date = VolumeDate(vRefNum);
+	rec.parID = pb->dirInfo.ioDrParID;
+	rec.dirID = pb->dirInfo.ioDrDirID;
+	rec.modDate = pb->dirInfo.ioDrMdDat;
+	rec.valence = pb->dirInfo.ioDrNmFls;
+	if(!gNewFailed && gNumNew % kRescanGrow == 0)
+	{
+		SetHandleSize(gNew, (gNumNew + kRescanGrow) * sizeof(FolderRec));
+		// Still skips, but this run won't be saved.
+		gNewFailed = MemError() != noErr;
+	}
+	if(!gNewFailed)
+		((FolderRec *)*gNew)[gNumNew++] = rec;
+	i = LowerBound(rec.date, rec.parID, rec.dirID);
+	if(i == gNumOld || CompareFolders(&gOld[i], &rec))
+		return false;
+	return gOld[i].modDate == rec.modDate && gOld[i].valence == rec.valence;
+}
+
+Boolean RescanNextChild(short vRefNum, long parID, long *cursor, long *dirID)
+{
+	UInt32 date;
+	long i;
+
+	if(!gRescanning)
+		return false;
+	date = VolumeDate(vRefNum);
+	i = *cursor ? *cursor - 1 : LowerBound(date, parID, 0);
+	if(i >= gNumOld || gOld[i].date != date || gOld[i].parID != (UInt32)parID)
+		return false;
+	*dirID = gOld[i].dirID;
+	*cursor = i + 2;
+	return true;
+}
+
+void RescanFailed(short vRefNum, long dirID)
+{
+	FolderRec *rec;
+	UInt32 date;
+	long i;
+
+	if(!gRescanning || !gNumNew)
+		return;
+	date = VolumeDate(vRefNum);
+	// Usually one of the last folders walked.
+	rec = (FolderRec *)*gNew;
+	for(i = gNumNew - 1; i >= 0; i--)
+		if(rec[i].dirID == (UInt32)dirID && rec[i].date == date)
+		{
+			rec[i].modDate = 0;
+			return;
+		}
+}
+
+static OSErr Write(short refNum, FolderRec *buf, short *count, const FolderRec *rec)
+{
+	long len;
+
+	if(rec)
+		buf[(*count)++] = *rec;
+	if(*count < kRescanBuf && rec)
+		return noErr;
+	len = *count * sizeof(FolderRec);
+	*count = 0;
+	return FSWrite(refNum, &len, buf);
+}
+
+// Both lists sorted; where they overlap, this run wins.
+static OSErr Save()
+{
+	FolderRec buf[kRescanBuf], header = { 0, 0, 0, 0, 0 }, *rec;
+	ParamBlockRec pb;
+	long i = 0, j = 0, len;
+	short refNum, count = 0, cmp;
+	OSErr err;
+
+	err = HCreate(0, 0, "\pFix-a-Fork Index", 'FAF ', 'FAFi');
+	if(err && err != dupFNErr)
+		return err;
+	err = HOpen(0, 0, "\pFix-a-Fork Index", fsWrPerm, &refNum);
+	if(err)
+		return err;
+	HLock(gNew);
+	rec = (FolderRec *)*gNew;
+	qsort(rec, gNumNew, sizeof(FolderRec), CompareFolders);
+	header.parID = Options();
+	SetEOF(refNum, 0);
+	err = Write(refNum, buf, &count, &header);
+	while(!err && (i < gNumOld || j < gNumNew))
+	{
+		cmp = i == gNumOld ? 1 : j == gNumNew ? -1 : CompareFolders(&gOld[i], &rec[j]);
+		if(cmp < 0)
+			err = Write(refNum, buf, &count, &gOld[i++]);
+		else
+		{
+			i += !cmp;
+			err = Write(refNum, buf, &count, &rec[j++]);
+		}
+	}
+	if(!err)
+		err = Write(refNum, buf, &count, nil);
+	HUnlock(gNew);
+	// A folder whose subfolders went missing would hide them, so the
+	// header only goes in once the rest is on disk. Until then, or if
+	// anything failed, the index is ignored.
+	if(!err)
+	{
+		pb.ioParam.ioCompletion = nil;
+		pb.ioParam.ioRefNum = refNum;
+		err = PBFlushFileSync(&pb);
+	}
+	if(!err)
+	{
+		header.date = kRescanMagic;
+		len = sizeof(header);
+		err = SetFPos(refNum, fsFromStart, 0);
+		if(!err)
+			err = FSWrite(refNum, &len, &header);
+	}
+	if(err)
+		SetEOF(refNum, 0);
+	FSClose(refNum);
+	FlushVol(nil, 0);
+	return err;
+}
+
+void RescanEnd(Boolean save)
+{
+	// A dry run fixes nothing, so nothing it saw can be skipped later.
+	if(gRescanning && save && !gBatch.dryRun && !gNewFailed)
+		Save();
+	Forget();
+}
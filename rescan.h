@@ -0,0 +1,35 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+#ifndef __RESCAN_H__
+#define __RESCAN_H__
+
+// Incremental rescans ('incr'). "Fix-a-Fork Index", next to the app,
+// holds each folder's modification date and valence from the last
+// recursive run. Adding, removing, renaming or moving anything in a
+// folder changes both, so a folder that still matches has no new files:
+// its files aren't listed again, only its subfolders are looked up, by
+// dirID, to check them in turn. Folders with a file that couldn't be
+// read or set, and folders touched after a fix, are listed again on the
+// next run.
+
+#include <MacTypes.h>
+#include <Files.h>
+
+#define kRescanGrow 256		// index records added at a time
+
+// Loads the index, if gBatch asks for an incremental recursive run.
+void RescanBegin();
+// Records folder pb (from PBGetCatInfo) for the next run. True if it's
+// unchanged since the last one, so only its subfolders need a look.
+Boolean RescanFolder(short vRefNum, const CInfoPBRec *pb);
+// The subfolders parID had last time, one per call; *cursor starts at 0.
+Boolean RescanNextChild(short vRefNum, long parID, long *cursor, long *dirID);
+// Something in dirID failed; it gets listed again next time.
+void RescanFailed(short vRefNum, long dirID);
+// save writes this run's folders to the index, merged with the ones it
+// didn't visit. Otherwise, as after a stopped or resumed run where some
+// folders weren't visited, the index is left as it was.
+void RescanEnd(Boolean save);
+
+#endif
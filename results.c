@@ -0,0 +1,247 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+
+#include "results.h"
+#include "detect.h"
+#include "charset.h"
+#include <stdbool.h>
+#include <string.h>
+
+static void Put(ResultLog *log, const void *p, long len)
+{
+	long n;
+
+	while(len > 0 && !log->err)
+	{
+		if(log->len == kResultBufSize)
+			ResultLogFlush(log);
+		n = kResultBufSize - log->len;
+		if(n > len)
+			n = len;
+		memcpy(log->buf + log->len, p, n);
+		log->len += n;
+		p = (const Byte *)p + n;
+		len -= n;
+	}
+}
+
+static void PutStr(ResultLog *log, const char *s)
+{
+	Put(log, s, StringLen(s));
+}
+
+// IDs and times are unsigned; catalog IDs can be 2^31 and up.
+static void PutDec(ResultLog *log, unsigned long v)
+{
+	char tmp[20];
+	short i = sizeof(tmp);
+
+	do {
+		tmp[--i] = '0' + v % 10;
+		v /= 10;
+	} while(v);
+	Put(log, tmp + i, sizeof(tmp) - i);
+}
+
+static void PutErr(ResultLog *log, OSErr err)
+{
+	if(err < 0)
+		Put(log, "-", 1);
+	PutDec(log, err < 0 ? -(long)err : err);
+}
+
+static void Put32(ResultLog *log, UInt32 v)
+{
+	Byte b[4];
+	b[0] = v >> 24;
+	b[1] = v >> 16;
+	b[2] = v >> 8;
+	b[3] = v;
+	Put(log, b, 4);
+}
+
+// Paths are Mac Roman on the Mac and already UTF-8 on the host.
+#if TARGET_OS_MAC
+#define kPathsMacRoman true
+#else
+#define kPathsMacRoman false
+#endif
+
+// Quoted string; JSON and CSV disagree on escaping. JSON has to be
+// UTF-8, so Mac Roman text is converted; CSV is written as is.
+static void PutQuoted(ResultLog *log, const char *s, long len, Boolean macRoman)
+{
+	static const char hex[] = "0123456789abcdef";
+	char esc[6];
+	UInt16 u;
+	long i;
+	Byte c;
+
+	Put(log, "\"", 1);
+	for(i = 0; i < len; i++)
+	{
+		c = s[i];
+		if(log->format == kResultCSV)
+		{
+			if(c == '"')
+				Put(log, "\"", 1);
+			Put(log, &c, 1);
+		}
+		else if(c == '"' || c == '\\')
+		{
+			esc[0] = '\\';
+			esc[1] = c;
+			Put(log, esc, 2);
+		}
+		else if(c < 0x20)
+		{
+			memcpy(esc, "\\u00", 4);
+			esc[4] = hex[c >> 4];
+			esc[5] = hex[c & 0xF];
+			Put(log, esc, 6);
+		}
+		else if(c >= 0x80 && macRoman)
+		{
+			u = kMacRomanHigh[c - 0x80];
+			if(u < 0x800)
+			{
+				esc[0] = 0xC0 | (u >> 6);
+				esc[1] = 0x80 | (u & 0x3F);
+				Put(log, esc, 2);
+			}
+			else
+			{
+				esc[0] = 0xE0 | (u >> 12);
+				esc[1] = 0x80 | ((u >> 6) & 0x3F);
+				esc[2] = 0x80 | (u & 0x3F);
+				Put(log, esc, 3);
+			}
+		}
+		else
+			Put(log, &c, 1);
+	}
+	Put(log, "\"", 1);
+}
+
+// Zero (no type at all) is an empty string rather than four NULs.
+static void PutOSType(ResultLog *log, OSType t)
+{
+	char s[4];
+	short i;
+
+	if(t == 0)
+	{
+		PutQuoted(log, "", 0, true);
+		return;
+	}
+	for(i = 0; i < 4; i++)
+		s[i] = t >> (24 - i * 8);
+	PutQuoted(log, s, 4, true);
+}
+
+void ResultLogOpen(ResultLog *log, short format, ResultWriteProc write, void *refCon, Boolean append)
+{
+	log->format = format;
+	log->write = write;
+	log->refCon = refCon;
+	log->err = noErr;
+	log->len = 0;
+	if(append)
+		return;
+	if(format == kResultCSV)
+		PutStr(log, "path,file_id,parent_id,old_type,old_creator,new_type,new_creator,detector,error,micros\n");
+	else if(format == kResultBinary)
+	{
+		Put32(log, kResultMagic);
+		Put32(log, (kResultVersion << 16) | kResultRecSize);
+	}
+}
+
+void ResultLogAppend(ResultLog *log, const ResultRec *r)
+{
+	const char *path = r->path ? r->path : "";
+
+	if(log->err)
+		return;
+	if(log->format == kResultBinary)
+	{
+		Put32(log, r->fileID);
+		Put32(log, r->parID);
+		Put32(log, r->oldType);
+		Put32(log, r->oldCreator);
+		Put32(log, r->newType);
+		Put32(log, r->newCreator);
+		Put32(log, r->micros);
+		Put32(log, ((UInt32)(UInt16)r->detector << 16) | (UInt16)r->err);
+		return;
+	}
+
+	if(log->format == kResultJSONL)
+	{
+		PutStr(log, "{\"path\":");
+		PutQuoted(log, path, StringLen(path), kPathsMacRoman);
+		PutStr(log, ",\"file_id\":");
+		PutDec(log, r->fileID);
+		PutStr(log, ",\"parent_id\":");
+		PutDec(log, r->parID);
+		PutStr(log, ",\"old_type\":");
+		PutOSType(log, r->oldType);
+		PutStr(log, ",\"old_creator\":");
+		PutOSType(log, r->oldCreator);
+		PutStr(log, ",\"new_type\":");
+		PutOSType(log, r->newType);
+		PutStr(log, ",\"new_creator\":");
+		PutOSType(log, r->newCreator);
+		PutStr(log, ",\"detector\":\"");
+		PutStr(log, DetectorName(r->detector));
+		PutStr(log, "\",\"error\":");
+		PutErr(log, r->err);
+		PutStr(log, ",\"micros\":");
+		PutDec(log, r->micros);
+		PutStr(log, "}\n");
+		return;
+	}
+
+	PutQuoted(log, path, StringLen(path), kPathsMacRoman);
+	Put(log, ",", 1);
+	PutDec(log, r->fileID);
+	Put(log, ",", 1);
+	PutDec(log, r->parID);
+	Put(log, ",", 1);
+	PutOSType(log, r->oldType);
+	Put(log, ",", 1);
+	PutOSType(log, r->oldCreator);
+	Put(log, ",", 1);
+	PutOSType(log, r->newType);
+	Put(log, ",", 1);
+	PutOSType(log, r->newCreator);
+	Put(log, ",", 1);
+	PutStr(log, DetectorName(r->detector));
+	Put(log, ",", 1);
+	PutErr(log, r->err);
+	Put(log, ",", 1);
+	PutDec(log, r->micros);
+	Put(log, "\n", 1);
+}
+
+OSErr ResultLogFlush(ResultLog *log)
+{
+	if(!log->err && log->len)
+		log->err = log->write(log->refCon, log->buf, log->len);
+	log->len = 0;
+	return log->err;
+}
+
+short ResultFormatForName(const char *name)
+{
+	short len = StringLen(name);
+
+	if(len >= 6 && StringCompare(name + len - 6, ".jsonl"))
+		return kResultJSONL;
+	if(len >= 5 && StringCompare(name + len - 5, ".json"))
+		return kResultJSONL;
+	if(len >= 4 && StringCompare(name + len - 4, ".csv"))
+		return kResultCSV;
+	return kResultBinary;
+}
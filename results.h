@@ -0,0 +1,64 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+#ifndef __RESULTS_H__
+#define __RESULTS_H__
+
+// Verdict records, streamed as JSON Lines, CSV or a fixed-width binary
+// log. Shared by the Mac app and the host tools; records are formatted
+// into a buffer and only handed to the write proc when it fills up, so
+// logging costs no I/O per file. Like detect.c, no Toolbox calls.
+
+#include <MacTypes.h>
+
+enum {
+	kResultJSONL,
+	kResultCSV,
+	kResultBinary
+};
+
+#define kResultBufSize 32768
+// Binary logs start with 'FAFL', a version and the record size, then
+// fixed 32 byte big-endian records: fileID, parID, old type, old
+// creator, new type, new creator, microseconds, detector, error. Paths
+// are left out; fileID/parID identify the file.
+#define kResultMagic 'FAFL'
+#define kResultVersion 1
+#define kResultRecSize 32
+
+typedef struct {
+	const char *path;	// UTF-8 on the host, Mac Roman on the Mac
+	UInt32 fileID;
+	UInt32 parID;
+	OSType oldType;
+	OSType oldCreator;
+	OSType newType;		// same as old when nothing changed
+	OSType newCreator;
+	short detector;		// kDetectNone when nothing matched
+	OSErr err;
+	UInt32 micros;		// time spent reading and classifying
+} ResultRec;
+
+// Returns noErr or an error, which sticks and stops further writes.
+typedef OSErr (*ResultWriteProc)(void *refCon, const void *buf, long len);
+
+typedef struct {
+	short format;
+	ResultWriteProc write;
+	void *refCon;
+	OSErr err;
+	long len;
+	Byte buf[kResultBufSize];
+} ResultLog;
+
+// Writes the CSV header row or binary file header, unless appending to
+// a log that already has one.
+void ResultLogOpen(ResultLog *log, short format, ResultWriteProc write, void *refCon, Boolean append);
+void ResultLogAppend(ResultLog *log, const ResultRec *r);
+// Flushes whatever is buffered. Returns the first error seen.
+OSErr ResultLogFlush(ResultLog *log);
+// kResultJSONL for ".jsonl"/".json", kResultCSV for ".csv", otherwise
+// kResultBinary.
+short ResultFormatForName(const char *name);
+
+#endif
@@ -0,0 +1,28 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+
+#include "Processes.r"
+
+// Background-only, so it never appears in the application menu, and
+// small enough to leave running between scripted batches.
+resource 'SIZE' (-1) {
+	reserved,
+	ignoreSuspendResumeEvents,
+	reserved,
+	canBackground,
+	doesActivateOnFGSwitch,
+	onlyBackground,
+	dontGetFrontClicks,
+	ignoreAppDiedEvents,
+	is32BitCompatible,
+	isHighLevelEventAware,
+	localAndRemoteHLEvents,
+	notStationeryAware,
+	dontUseTextEditServices,
+	reserved,
+	reserved,
+	reserved,
+	256 * 1024,
+	192 * 1024
+};
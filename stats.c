@@ -0,0 +1,170 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+
+#include "stats.h"
+
+#if FAF_STATS
+#include <string.h>
+
+typedef struct {
+	UInt32 at;		// since launch
+	UInt32 micros;
+	short stage;
+} StatsEvent;
+
+typedef struct {
+	StatsClockProc clock;
+	UInt32 launch;
+	UInt32 firstFile;	// 0 until one has been classified
+	long files;
+	long stageCount[kStageCount];
+	UInt32 stageMicros[kStageCount];
+	long hits[kStatsMaxDetectors];
+	long misses[kStatsMaxDetectors];
+	long extHits;
+	long extMisses;
+	StatsEvent ring[kStatsRingSize];
+	long ringNext;		// total events so far
+} Stats;
+
+typedef struct {
+	ResultWriteProc write;
+	void *refCon;
+	OSErr err;
+	short len;
+	char buf[256];
+} StatsOut;
+
+static const char *kStageNames[kStageCount] = { "read", "sniff", "setinfo", "touch" };
+static Stats gStats;
+
+void StatsInit(StatsClockProc clock)
+{
+	memset(&gStats, 0, sizeof(gStats));
+	gStats.clock = clock;
+	gStats.launch = clock();
+}
+
+UInt32 StatsNow(void)
+{
+	return gStats.clock ? gStats.clock() : 0;
+}
+
+void StatsStage(short stage, UInt32 start)
+{
+	UInt32 now = StatsNow();
+	StatsEvent *e = &gStats.ring[gStats.ringNext++ % kStatsRingSize];
+
+	gStats.stageCount[stage]++;
+	gStats.stageMicros[stage] += now - start;
+	e->at = start - gStats.launch;
+	e->micros = now - start;
+	e->stage = stage;
+}
+
+void StatsSniff(const SniffRec *s)
+{
+	short i, n = DetectorCount();
+
+	if(n > kStatsMaxDetectors)
+		n = kStatsMaxDetectors;
+	if(!gStats.files++)
+		gStats.firstFile = StatsNow() - gStats.launch;
+	for(i = 0; i < n && i != s->detector; i++)
+		gStats.misses[i]++;
+	if(i < n)
+		gStats.hits[i]++;
+	else if(s->detector == kDetectExt)
+		gStats.extHits++;
+	else
+		gStats.extMisses++;
+}
+
+static void Flush(StatsOut *out)
+{
+	if(out->len && !out->err)
+		out->err = out->write(out->refCon, out->buf, out->len);
+	out->len = 0;
+}
+
+static void PutStr(StatsOut *out, const char *s)
+{
+	while(*s)
+	{
+		if(out->len == sizeof(out->buf))
+			Flush(out);
+		out->buf[out->len++] = *s++;
+	}
+}
+
+static void PutDec(StatsOut *out, unsigned long v)
+{
+	char tmp[12];
+	short i = sizeof(tmp);
+
+	tmp[--i] = 0;
+	do {
+		tmp[--i] = '0' + v % 10;
+		v /= 10;
+	} while(v);
+	PutStr(out, tmp + i);
+}
+
+OSErr StatsDump(ResultWriteProc write, void *refCon)
+{
+	StatsOut out;
+	long i, first;
+	short n = DetectorCount();
+
+	out.write = write;
+	out.refCon = refCon;
+	out.err = noErr;
+	out.len = 0;
+	if(n > kStatsMaxDetectors)
+		n = kStatsMaxDetectors;
+
+	PutStr(&out, "files\t");
+	PutDec(&out, gStats.files);
+	PutStr(&out, "\nfirst file after us\t");
+	PutDec(&out, gStats.firstFile);
+	PutStr(&out, "\n\nstage\tcount\tmicros\n");
+	for(i = 0; i < kStageCount; i++)
+	{
+		PutStr(&out, kStageNames[i]);
+		PutStr(&out, "\t");
+		PutDec(&out, gStats.stageCount[i]);
+		PutStr(&out, "\t");
+		PutDec(&out, gStats.stageMicros[i]);
+		PutStr(&out, "\n");
+	}
+	PutStr(&out, "\ndetector\thits\tmisses\n");
+	for(i = 0; i < n; i++)
+	{
+		PutStr(&out, DetectorName(i));
+		PutStr(&out, "\t");
+		PutDec(&out, gStats.hits[i]);
+		PutStr(&out, "\t");
+		PutDec(&out, gStats.misses[i]);
+		PutStr(&out, "\n");
+	}
+	PutStr(&out, "Ext\t");
+	PutDec(&out, gStats.extHits);
+	PutStr(&out, "\t");
+	PutDec(&out, gStats.extMisses);
+	PutStr(&out, "\n\nat\tstage\tmicros\n");
+	first = gStats.ringNext > kStatsRingSize ? gStats.ringNext - kStatsRingSize : 0;
+	for(i = first; i < gStats.ringNext; i++)
+	{
+		StatsEvent *e = &gStats.ring[i % kStatsRingSize];
+		PutDec(&out, e->at);
+		PutStr(&out, "\t");
+		PutStr(&out, kStageNames[e->stage]);
+		PutStr(&out, "\t");
+		PutDec(&out, e->micros);
+		PutStr(&out, "\n");
+	}
+	Flush(&out);
+	return out.err;
+}
+#endif
@@ -0,0 +1,55 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+#ifndef __STATS_H__
+#define __STATS_H__
+
+// Tuning counters, built in with FAF_STATS=1: hits and misses for each
+// detector, time spent in each stage, and how long after launch the
+// first file was classified. The last kStatsRingSize stage timings are
+// kept in a fixed ring. Nothing allocates and the clock is passed in, so
+// like detect.c this makes no Toolbox calls. Only call it from one
+// thread at a time. Without FAF_STATS every call is an empty macro.
+
+#include <MacTypes.h>
+#include "detect.h"
+#include "results.h"
+
+#ifndef FAF_STATS
+#define FAF_STATS 0
+#endif
+
+enum {
+	kStageRead,		// open, read SNIFF_SIZE, close
+	kStageSniff,
+	kStageSetInfo,	// writing the new type/creator
+	kStageTouch,	// bumping the folder's mod date
+	kStageCount
+};
+
+#define kStatsRingSize 256
+#define kStatsMaxDetectors 16
+
+// Microseconds, wrapping.
+typedef UInt32 (*StatsClockProc)(void);
+
+#if FAF_STATS
+// Starts the launch clock; call first thing.
+void StatsInit(StatsClockProc clock);
+UInt32 StatsNow(void);
+// Charges the time since start to stage.
+void StatsStage(short stage, UInt32 start);
+// A hit for the detector that fired and a miss for every one tried
+// before it. Short files count as misses for the checks @ 1024.
+void StatsSniff(const SniffRec *s);
+// Writes the totals and the ring as text.
+OSErr StatsDump(ResultWriteProc write, void *refCon);
+#else
+#define StatsInit(clock)
+#define StatsNow() 0
+#define StatsStage(stage, start) ((void)(start))
+#define StatsSniff(s)
+#define StatsDump(write, refCon) noErr
+#endif
+
+#endif
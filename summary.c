@@ -0,0 +1,382 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+
+#include "summary.h"
+#include <Controls.h>
+#include <Files.h>
+#include <Fonts.h>
+#include <Memory.h>
+#include <Quickdraw.h>
+#include <TextEdit.h>
+#include <TextUtils.h>
+#include <Windows.h>
+#if TARGET_API_MAC_CARBON
+#include <CarbonEvents.h>
+#include <Navigation.h>
+#else
+#include <StandardFile.h>
+#endif
+
+// TextEdit can't show more than this; saving writes everything.
+#define kMaxShown 32000L
+
+#if TARGET_API_MAC_CARBON
+#define WindowBounds(w, r) GetWindowPortBounds(w, r)
+#define SetWindowPort(w) SetPortWindowPort(w)
+#else
+#define WindowBounds(w, r) (*(r) = (w)->portRect)
+#define SetWindowPort(w) SetPort(w)
+#endif
+
+Handle gSummaryText = nil;	// one line per failure or note, CR separated
+WindowPtr gSummaryWindow = nil;
+TEHandle gSummaryTE = nil;
+ControlHandle gSummaryScroll = nil;
+ControlActionUPP gScrollUPP = nil;
+
+static void AppendText(const void *p, long len)
+{
+	PtrAndHand(p, gSummaryText, len);
+}
+
+static void AppendNum(long n)
+{
+	Str255 s;
+	NumToString(n, s);
+	AppendText(s + 1, s[0]);
+}
+
+void SummaryBegin()
+{
+	if(!gSummaryText)
+		gSummaryText = NewHandle(0);
+	else
+		SetHandleSize(gSummaryText, 0);
+}
+
+void SummaryAdd(const unsigned char *fName, short what, OSErr err)
+{
+	if(!gSummaryText)
+		SummaryBegin();
+	AppendText(fName + 1, fName[0]);
+	switch(what)
+	{
+		case kSummaryUnknown:
+			AppendText("\tcouldn't determine type/creator", 32);
+			break;
+		case kSummarySetFailed:
+			AppendText("\tcouldn't set type/creator", 26);
+			break;
+		case kSummaryOpenFailed:
+			AppendText("\tcouldn't be read", 17);
+			break;
+	}
+	if(err)
+	{
+		AppendText(", error ", 8);
+		AppendNum(err);
+	}
+	AppendText("\r", 1);
+}
+
+void SummaryCancelled(long remaining)
+{
+	if(!gSummaryText)
+		SummaryBegin();
+	AppendText("Stopped with ", 13);
+	AppendNum(remaining);
+	AppendText(" files left\r", 12);
+}
+
+void SummaryResumed(long finished)
+{
+	if(!gSummaryText)
+		SummaryBegin();
+	AppendText("Picked up a stopped run, skipped ", 33);
+	AppendNum(finished);
+	AppendText(" finished folders and items\r", 28);
+}
+
+static short LinesInView()
+{
+	return ((*gSummaryTE)->viewRect.bottom - (*gSummaryTE)->viewRect.top) / (*gSummaryTE)->lineHeight;
+}
+
+static void ScrollTo(short line)
+{
+	short current = ((*gSummaryTE)->viewRect.top - (*gSummaryTE)->destRect.top) / (*gSummaryTE)->lineHeight;
+	TEScroll(0, (current - line) * (*gSummaryTE)->lineHeight, gSummaryTE);
+}
+
+static pascal void ScrollAction(ControlHandle control, ControlPartCode part)
+{
+	short page = LinesInView() - 1, delta;
+
+	switch(part)
+	{
+		case kControlUpButtonPart:
+			delta = -1;
+			break;
+		case kControlDownButtonPart:
+			delta = 1;
+			break;
+		case kControlPageUpPart:
+			delta = -page;
+			break;
+		case kControlPageDownPart:
+			delta = page;
+			break;
+		case kControlIndicatorPart:
+			// Live thumb tracking (Carbon's live scroll bar).
+			ScrollTo(GetControlValue(control));
+			return;
+		default:
+			return;
+	}
+	SetControlValue(control, GetControlValue(control) + delta);
+	ScrollTo(GetControlValue(control));
+}
+
+#if TARGET_API_MAC_CARBON
+static pascal OSStatus SummaryWindowEvent(EventHandlerCallRef next, EventRef event, void *refCon)
+{
+	Rect r;
+
+	switch(GetEventKind(event))
+	{
+		case kEventWindowDrawContent:
+			SetWindowPort(gSummaryWindow);
+			WindowBounds(gSummaryWindow, &r);
+			EraseRect(&r);
+			TEUpdate(&r, gSummaryTE);
+			DrawControls(gSummaryWindow);
+			return noErr;
+		case kEventWindowClose:
+			SummaryClose();
+			return noErr;
+	}
+	return eventNotHandledErr;
+}
+#endif
+
+static void CreateSummaryWindow()
+{
+	Rect bounds = { 60, 40, 360, 560 }, view, scroll;
+	short monaco;
+
+#if TARGET_API_MAC_CARBON
+	EventTypeSpec events[] = {
+		{ kEventClassWindow, kEventWindowDrawContent },
+		{ kEventClassWindow, kEventWindowClose }
+	};
+
+	CreateNewWindow(kDocumentWindowClass, kWindowCloseBoxAttribute | kWindowCollapseBoxAttribute | kWindowStandardHandlerAttribute,
+		&bounds, &gSummaryWindow);
+	SetWTitle(gSummaryWindow, "\pFix-a-Fork Summary");
+	InstallWindowEventHandler(gSummaryWindow, NewEventHandlerUPP(SummaryWindowEvent), 2, events, nil, nil);
+#else
+	gSummaryWindow = NewCWindow(nil, &bounds, "\pFix-a-Fork Summary", false, noGrowDocProc, (WindowPtr)-1, true, 0);
+#endif
+	SetWindowPort(gSummaryWindow);
+	GetFNum("\pMonaco", &monaco);
+	TextFont(monaco);
+	TextSize(9);
+
+	WindowBounds(gSummaryWindow, &view);
+	scroll = view;
+	scroll.left = scroll.right - 15;
+	scroll.top -= 1;
+	scroll.right += 1;
+	scroll.bottom += 1;
+	view.right -= 15;
+	InsetRect(&view, 4, 4);
+	gSummaryTE = TENew(&view, &view);
+
+	if(!gScrollUPP)
+		gScrollUPP = NewControlActionUPP(ScrollAction);
+#if TARGET_API_MAC_CARBON
+	gSummaryScroll = NewControl(gSummaryWindow, &scroll, "\p", true, 0, 0, 0, kControlScrollBarLiveProc, 0);
+	SetControlAction(gSummaryScroll, gScrollUPP);
+#else
+	gSummaryScroll = NewControl(gSummaryWindow, &scroll, "\p", true, 0, 0, 0, scrollBarProc, 0);
+#endif
+}
+
+void SummaryEnd()
+{
+	long len;
+	short max;
+	Rect r;
+
+	// Nothing to report: don't leave an earlier run's window up.
+	if(!gSummaryText || !GetHandleSize(gSummaryText))
+	{
+		SummaryClose();
+		return;
+	}
+	if(!gSummaryWindow)
+		CreateSummaryWindow();
+	if(!gSummaryWindow || !gSummaryTE)
+		return;
+
+	len = GetHandleSize(gSummaryText);
+	HLock(gSummaryText);
+	TESetText(*gSummaryText, len < kMaxShown ? len : kMaxShown, gSummaryTE);
+	HUnlock(gSummaryText);
+	(*gSummaryTE)->destRect = (*gSummaryTE)->viewRect;
+	TECalText(gSummaryTE);
+
+	max = (*gSummaryTE)->nLines - LinesInView();
+	SetControlMaximum(gSummaryScroll, max > 0 ? max : 0);
+	SetControlValue(gSummaryScroll, 0);
+
+	SetWindowPort(gSummaryWindow);
+	WindowBounds(gSummaryWindow, &r);
+#if TARGET_API_MAC_CARBON
+	InvalWindowRect(gSummaryWindow, &r);
+#else
+	InvalRect(&r);
+#endif
+	ShowWindow(gSummaryWindow);
+	SelectWindow(gSummaryWindow);
+}
+
+Boolean SummaryIsOpen()
+{
+	return gSummaryWindow != nil;
+}
+
+void SummaryClose()
+{
+	if(!gSummaryWindow)
+		return;
+	TEDispose(gSummaryTE);
+	DisposeWindow(gSummaryWindow);
+	gSummaryTE = nil;
+	gSummaryScroll = nil;
+	gSummaryWindow = nil;
+}
+
+static OSErr WriteSummary(FSSpec *spec, ScriptCode script)
+{
+	OSErr err;
+	short refNum;
+	long len = GetHandleSize(gSummaryText);
+
+	err = FSpCreate(spec, 'ttxt', 'TEXT', script);
+	if(err && err != dupFNErr)
+		return err;
+	err = FSpOpenDF(spec, fsWrPerm, &refNum);
+	if(err)
+		return err;
+	HLock(gSummaryText);
+	err = FSWrite(refNum, &len, *gSummaryText);
+	HUnlock(gSummaryText);
+	if(!err)
+		err = SetEOF(refNum, len);
+	FSClose(refNum);
+	FlushVol(nil, spec->vRefNum);
+	return err;
+}
+
+void SummarySave()
+{
+	FSSpec spec;
+#if TARGET_API_MAC_CARBON
+	NavDialogOptions options;
+	NavReplyRecord reply;
+	AEKeyword keyword;
+	DescType type;
+	Size size;
+
+	if(!gSummaryText)
+		return;
+	NavGetDefaultDialogOptions(&options);
+	PLstrcpy(options.savedFileName, "\pFix-a-Fork Summary");
+	if(NavPutFile(nil, &reply, &options, nil, 'TEXT', 'ttxt', nil) != noErr)
+		return;
+	if(reply.validRecord && AEGetNthPtr(&reply.selection, 1, typeFSS, &keyword, &type, &spec, sizeof(spec), &size) == noErr
+		&& WriteSummary(&spec, reply.keyScript) == noErr)
+		NavCompleteSave(&reply, kNavTranslateInPlace);
+	NavDisposeReply(&reply);
+#else
+	StandardFileReply reply;
+
+	if(!gSummaryText)
+		return;
+	StandardPutFile("\pSave summary as:", "\pFix-a-Fork Summary", &reply);
+	if(reply.sfGood)
+	{
+		spec = reply.sfFile;
+		WriteSummary(&spec, reply.sfScript);
+	}
+#endif
+}
+
+#if !TARGET_API_MAC_CARBON
+Boolean SummaryEvent(EventRecord *event)
+{
+	WindowPtr window;
+	ControlHandle control;
+	short part;
+	Point pt;
+
+	if(!gSummaryWindow)
+		return false;
+	switch(event->what)
+	{
+		case updateEvt:
+			if((WindowPtr)event->message != gSummaryWindow)
+				return false;
+			BeginUpdate(gSummaryWindow);
+			SetPort(gSummaryWindow);
+			EraseRect(&gSummaryWindow->portRect);
+			TEUpdate(&gSummaryWindow->portRect, gSummaryTE);
+			DrawControls(gSummaryWindow);
+			EndUpdate(gSummaryWindow);
+			return true;
+		case activateEvt:
+			if((WindowPtr)event->message != gSummaryWindow)
+				return false;
+			HiliteControl(gSummaryScroll, (event->modifiers & activeFlag) ? 0 : 255);
+			return true;
+		case mouseDown:
+			part = FindWindow(event->where, &window);
+			if(window != gSummaryWindow)
+				return false;
+			switch(part)
+			{
+				case inDrag:
+					DragWindow(gSummaryWindow, event->where, &qd.screenBits.bounds);
+					break;
+				case inGoAway:
+					if(TrackGoAway(gSummaryWindow, event->where))
+						SummaryClose();
+					break;
+				case inContent:
+					if(gSummaryWindow != FrontWindow())
+					{
+						SelectWindow(gSummaryWindow);
+						break;
+					}
+					SetPort(gSummaryWindow);
+					pt = event->where;
+					GlobalToLocal(&pt);
+					part = FindControl(pt, gSummaryWindow, &control);
+					if(control != gSummaryScroll || !part)
+						break;
+					if(part == kControlIndicatorPart)
+					{
+						TrackControl(control, pt, nil);
+						ScrollTo(GetControlValue(control));
+					}
+					else
+						TrackControl(control, pt, gScrollUPP);
+					break;
+			}
+			return true;
+	}
+	return false;
+}
+#endif
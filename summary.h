@@ -0,0 +1,37 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+#ifndef __SUMMARY_H__
+#define __SUMMARY_H__
+
+// Failures from a batch are collected here instead of putting up an
+// alert per file, then shown once in a scrolling window that can be
+// saved as a text file.
+
+#include <MacTypes.h>
+#include <Events.h>
+
+enum {
+	kSummaryUnknown,	// no detector matched
+	kSummarySetFailed,	// matched, but the type/creator couldn't be written
+	kSummaryOpenFailed	// couldn't be opened or read
+};
+
+void SummaryBegin();
+void SummaryAdd(const unsigned char *fName, short what, OSErr err);
+// The batch was stopped with remaining files untouched.
+void SummaryCancelled(long remaining);
+// Notes that finished folders and items of a stopped run were skipped.
+void SummaryResumed(long finished);
+// Shows the window if anything failed since SummaryBegin.
+void SummaryEnd();
+Boolean SummaryIsOpen();
+void SummarySave();
+void SummaryClose();
+#if !TARGET_API_MAC_CARBON
+// Update, activate and clicks for the summary window, from the classic
+// event loop. Returns true if the event was the summary window's.
+Boolean SummaryEvent(EventRecord *event);
+#endif
+
+#endif
@@ -0,0 +1,34 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+
+#include "weak.h"
+#if WEAK_IMPORTS
+#include <CodeFragments.h>
+#include <string.h>
+
+Boolean WeakImport(ConstStr63Param lib, const WeakImportRec *recs, short count)
+{
+	CFragConnectionID conn;
+	CFragSymbolClass symClass;
+	Ptr mainAddr, addr;
+	Str255 errName, symName;
+	short i;
+
+	if(GetSharedLibrary(lib, kPowerPCCFragArch, kReferenceCFrag, &conn, &mainAddr, errName) != noErr)
+		return false;
+	for(i = 0; i < count; i++)
+	{
+		symName[0] = strlen(recs[i].name);
+		memcpy(symName + 1, recs[i].name, symName[0]);
+		if(FindSymbol(conn, symName, &addr, &symClass) != noErr)
+		{
+			while(i--)
+				*recs[i].proc = nil;
+			return false;
+		}
+		*recs[i].proc = addr;
+	}
+	return true;
+}
+#endif
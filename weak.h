@@ -0,0 +1,30 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+#ifndef __WEAK_H__
+#define __WEAK_H__
+
+// Classic PowerPC builds don't import NavigationLib, ThreadsLib or
+// MPLibrary: the Code Fragment Manager won't launch an app whose
+// imports are missing, and each of them has a fallback. The calls go
+// through pointers looked up at run time instead. A module declares
+// them with WeakProc, lists them with WeakRec, defines each name as
+// (*gWeakName), and calls WeakImport before using any of them.
+
+#include <MacTypes.h>
+
+#define WEAK_IMPORTS (TARGET_CPU_PPC && !TARGET_API_MAC_CARBON)
+
+typedef struct {
+	const char *name;
+	void **proc;
+} WeakImportRec;
+
+#define WeakProc(f) static __typeof__(f) *gWeak##f = nil
+#define WeakRec(f) { #f, (void **)&gWeak##f }
+
+// Connects to lib and fills in every proc. False, with all of them
+// nil, if the library or any one symbol is missing.
+Boolean WeakImport(ConstStr63Param lib, const WeakImportRec *recs, short count);
+
+#endif
@@ -0,0 +1,116 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+
+#include "workers.h"
+#include "weak.h"
+#if TARGET_CPU_PPC
+#include <Multiprocessing.h>
+#endif
+
+#define kMaxWorkers 8
+// Work in flight is bounded by the pipeline's jobs; reserving this much
+// means posting never has to allocate.
+#define kQueueReserve 32
+
+#if WEAK_IMPORTS
+WeakProc(MPProcessors);
+WeakProc(MPCreateQueue);
+WeakProc(MPSetQueueReserve);
+WeakProc(MPCreateTask);
+WeakProc(MPNotifyQueue);
+WeakProc(MPWaitOnQueue);
+
+static const WeakImportRec kMPImports[] = {
+	WeakRec(MPProcessors),
+	WeakRec(MPCreateQueue),
+	WeakRec(MPSetQueueReserve),
+	WeakRec(MPCreateTask),
+	WeakRec(MPNotifyQueue),
+	WeakRec(MPWaitOnQueue)
+};
+
+#define MPProcessors (*gWeakMPProcessors)
+#define MPCreateQueue (*gWeakMPCreateQueue)
+#define MPSetQueueReserve (*gWeakMPSetQueueReserve)
+#define MPCreateTask (*gWeakMPCreateTask)
+#define MPNotifyQueue (*gWeakMPNotifyQueue)
+#define MPWaitOnQueue (*gWeakMPWaitOnQueue)
+#endif
+
+#if TARGET_CPU_PPC
+MPQueueID gRequests = kInvalidID;
+MPQueueID gResults = kInvalidID;
+Boolean gWorkersTried = false;
+Boolean gWorkersRunning = false;
+
+static OSStatus SniffTask(void *param)
+{
+	void *s, *fName, *refCon;
+
+	while(MPWaitOnQueue(gRequests, &s, &fName, &refCon, kDurationForever) == noErr)
+		MPNotifyQueue(gResults, refCon, (void *)(long)SniffFile(s, fName), nil);
+	return noErr;
+}
+
+Boolean WorkersStart()
+{
+	MPTaskID task;
+	ItemCount i, count;
+
+	if(gWorkersTried)
+		return gWorkersRunning;
+	gWorkersTried = true;
+	// MPLibraryIsLoaded is a macro over a symbol of its own; the import
+	// succeeding is the same check.
+#if WEAK_IMPORTS
+	if(!WeakImport("\pMPLibrary", kMPImports, sizeof(kMPImports) / sizeof(kMPImports[0])))
+		return false;
+#else
+	if(!MPLibraryIsLoaded())
+		return false;
+#endif
+	if(MPProcessors() < 2)
+		return false;
+	if(MPCreateQueue(&gRequests) || MPCreateQueue(&gResults))
+		return false;
+	MPSetQueueReserve(gRequests, kQueueReserve);
+	MPSetQueueReserve(gResults, kQueueReserve);
+	count = MPProcessors() < kMaxWorkers ? MPProcessors() : kMaxWorkers;
+	// The tasks live as long as the app; they sleep on gRequests.
+	for(i = 0; i < count; i++)
+		if(MPCreateTask(SniffTask, nil, 0, kInvalidID, nil, nil, 0, &task) == noErr)
+			gWorkersRunning = true;
+	return gWorkersRunning;
+}
+
+void WorkersPost(SniffRec *s, const unsigned char *fName, void *refCon)
+{
+	MPNotifyQueue(gRequests, s, (void *)fName, refCon);
+}
+
+void *WorkersTake(Boolean *found)
+{
+	void *refCon, *result, *unused;
+
+	if(MPWaitOnQueue(gResults, &refCon, &result, &unused, kDurationImmediate) != noErr)
+		return nil;
+	*found = (long)result != 0;
+	return refCon;
+}
+#else
+// No MP Services on 68K; the pipeline classifies in place.
+Boolean WorkersStart()
+{
+	return false;
+}
+
+void WorkersPost(SniffRec *s, const unsigned char *fName, void *refCon)
+{
+}
+
+void *WorkersTake(Boolean *found)
+{
+	return nil;
+}
+#endif
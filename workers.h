@@ -0,0 +1,24 @@
+/*
+	Copyright Eric Helgeson 2023-2024.
+*/
+#ifndef __WORKERS_H__
+#define __WORKERS_H__
+
+// Classification on every CPU, with Multiprocessing Services tasks fed
+// through an MPQueue. Only SniffFile runs in the tasks; it never calls
+// the Toolbox (see detect.h), so it is MP-safe. File Manager I/O and
+// the UI stay with the main task.
+
+#include <MacTypes.h>
+#include "detect.h"
+
+// Starts the tasks, once. False on a single CPU or without MP, when
+// sniffing in place is cheaper than handing work over.
+Boolean WorkersStart();
+// refCon comes back from WorkersTake when s has been classified. s and
+// fName must stay put until then.
+void WorkersPost(SniffRec *s, const unsigned char *fName, void *refCon);
+// A finished refCon, or nil if none is ready; never waits.
+void *WorkersTake(Boolean *found);
+
+#endif